@@ -24,14 +24,18 @@
 #include <gtk/gtk.h>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <sys/mman.h>
 
 using std::string;
 using std::vector;
 
 const char* const gtitle = "Picpuz v.2.7";                                                    //  version
-#define Tindex(row,col) row * Ncols + col                                        //  map row/col to linear index
-#define drand(seed,range) (drandz(&seed) * range)                                //  random double, 0.0 to 0.9999 * range
-#define lrand(seed,range) (lrandz(&seed) % range)                                //  random integer, 0 to range-1
+#define Tindex(row,col) ((row) * Ncols + (col))                                  //  map row/col to linear index
+#define drand(seed,range) (drandz(&seed) * (range))                              //  random double, 0.0 to 0.9999 * range
+#define lrand(seed,range) (lrandz(&seed) % (range))                              //  random integer, 0 to range-1
 #define interp GDK_INTERP_BILINEAR
 #define GDKRGB GDK_COLORSPACE_RGB
 
@@ -39,14 +43,19 @@ GtkWidget      *win1, *vbox1, *dwin1;
 GtkWidget      *win2, *dwin2;                                                    //  reference and drawing window
 GtkWidget      *stbar;
 PIXBUF         *iPixbuf;                                                         //  full size image pixbuff
-PIXBUF         *wPixbuf;                                                         //  image pixbuf for window
-cairo_t        *mwcr;                                                            //  main window cairo context
+cairo_surface_t   *board;                                                        //  board image, persistent off-screen
+cairo_t        *bcr;                                                             //  board image cairo context
+cairo_surface_t   *wSurface;                                                     //  image scaled to window, cairo format
+cairo_surface_t   *atlas;                                                        //  tile atlas: body + lobe per home tile
+cairo_pattern_t   *atlasPattern;                                                 //  atlas source pattern for tile blits
+cairo_surface_t   *refSurface;                                                   //  reference image scaled to window
 
 #define MWIN GTK_WINDOW(win1)
 
 timeval     rtime;
 int64       rseed;                                                               //  random number seed
 int         debug = 0;                                                           //  from command line: -d
+double      animtime = 1.0;                                                      //  max. do-N time, -a secs (0 = instant)
 
 string        imagedirk = "";                                                //  image directory
 string        clfile = "";                                                   //  command line file
@@ -62,12 +71,221 @@ int         Nmoves = 0;
 int         Nhome = 0;                                                           //  tiles at home position
 int         Mstate = 0;                                                          //  mouse, tile select state
 int         linecolor = 0;                                                       //  0/1/2/3 = white/black/red/green
+int         atlasW, atlasH;                                                      //  tile size of atlas
+int         allocW, allocH;                                                      //  window allocation used for tiles
+int         Ndirty = 0;                                                          //  count of tiles to redraw
+
+#define     maxlevels 16                                                         //  image pyramid levels
+PIXBUF      *levels[maxlevels];                                                  //  [0] = iPixbuf, [N] = 1/2**N size
+int         Nlevels = 0;                                                         //  levels completed
+int         pyramid_busy = 0;                                                    //  build thread is running
+volatile int pyramid_stop = 0;                                                   //  request thread to stop
+int         pyramid_gen = 0;                                                     //  pyramid generation (image)
+pthread_t   pyramid_tid;                                                         //  build thread
+mutex_t     pyramid_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int         rescale_gen = 0;                                                     //  window image generation
+int         rescale_timer = 0;                                                   //  pending timeout, HQ rescale
+int         Npreview = 0;                                                        //  preview rescales, current resize
+int         Navoided = 0;                                                        //  full rescales avoided, total
+
+int         (*anim_step)(int kk);                                                //  animation step function
+int         anim_Nsteps, anim_Ndone;                                             //  animation steps, total and done
+double      anim_secs;                                                           //  animation duration
+int64       anim_t0;                                                             //  first frame time, microsecs
+uint        anim_tick = 0;                                                       //  frame clock tick callback ID
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__                                       //  saved puzzle files are little-endian
+inline uint32 le32(uint32 vv) { return __builtin_bswap32(vv); }
+inline uint64 le64(uint64 vv) { return __builtin_bswap64(vv); }
+#else
+inline uint32 le32(uint32 vv) { return vv; }
+inline uint64 le64(uint64 vv) { return vv; }
+#endif
+
+inline void varint_put(vector<uint8> &buff, uint64 vv) {                         //  7 bits per byte, low first,
+   while (vv >= 0x80) {                                                          //    0x80 = more bytes follow
+      buff.push_back(vv | 0x80);
+      vv >>= 7;
+   }
+   buff.push_back(vv);
+}
+
+inline int varint_get(const uint8 *&pp, const uint8 *pend, uint64 &vv) {         //  returns 0 if truncated or too long
+   vv = 0;
+   for (int sh = 0; sh < 64 && pp < pend; sh += 7) {
+      uint8 bb = *pp++;
+      vv |= (uint64) (bb & 0x7f) << sh;
+      if (! (bb & 0x80)) return 1;
+   }
+   return 0;
+}
+
+//  Puzzle state: the tile permutation and its inverse, as linear indices
+//  Tindex(row,col). A home tile is identified by its home position.
+//  Only puzzle_state<uint32> is used: 4 bytes per tile and map, 8 MB for
+//  a 1000x1000 board. Tdirty, Tvisit, Tqueue, Mtiles and Mposn add 17 bytes
+//  per tile, the joined groups 16 to 24: 41 to 49 bytes per tile in all.
+
+template <class T> class puzzle_state
+{
+   vector<T>   wpos;                                                             //  window position of home tile
+   vector<T>   hpos;                                                             //  home tile at window position
+
+public:
+   void init(int Nt) {                                                           //  all tiles at home
+      wpos.resize(Nt);
+      hpos.resize(Nt);
+      for (int ii = 0; ii < Nt; ii++) wpos[ii] = hpos[ii] = ii;
+   }
+   int  wposn(int tile) const { return wpos[tile]; }                             //  window position of home tile
+   int  hposn(int posn) const { return hpos[posn]; }                             //  home tile at window position
+   int  home(int posn) const { return (int) hpos[posn] == posn; }                //  tile at posn is home
+   void set_wposn(int tile, int posn) { wpos[tile] = posn; }                     //  set, then call set_hposn()
+   void set_hposn() {                                                            //  inverse of window positions
+      for (int ii = 0; ii < (int) wpos.size(); ii++) hpos[wpos[ii]] = ii;
+   }
+   uint32 load(const uint32 *posn, int Nt) {                                     //  window positions, little-endian,
+      wpos.resize(Nt);                                                           //    e.g. mapped file, returns max.
+      hpos.resize(Nt);                                                           //    (check < Nt, call set_hposn())
+      uint32 pmax = 0;
+      for (int ii = 0; ii < Nt; ii++) {
+         uint32 pp = le32(posn[ii]);
+         if (pp > pmax) pmax = pp;
+         wpos[ii] = pp;
+      }
+      return pmax;
+   }
+   int repair() {                                                                //  make window positions a permutation:
+      int Nt = wpos.size();                                                      //    duplicates get unused positions,
+      vector<uint64> used((Nt + 63) / 64, 0);                                    //    returns tiles moved, O(N)
+      vector<int> dups;                                                          //    (all positions < Nt)
+      for (int ii = 0; ii < Nt; ii++) {
+         uint32 pp = wpos[ii];
+         if (used[pp >> 6] >> (pp & 63) & 1) dups.push_back(ii);
+         else used[pp >> 6] |= 1ULL << (pp & 63);
+      }
+      size_t kk = 0;
+      for (int pp = 0; pp < Nt && kk < dups.size(); pp++)                        //  as many unused as duplicates
+         if (! (used[pp >> 6] >> (pp & 63) & 1)) wpos[dups[kk++]] = pp;
+      return dups.size();
+   }
+   void place(int posn, int tile) {                                              //  put tile at window position
+      hpos[posn] = tile;                                                         //    (caller keeps maps consistent)
+      wpos[tile] = posn;
+   }
+   void swap(int posn1, int posn2) {                                             //  swap tiles at 2 window positions
+      T tile1 = hpos[posn1], tile2 = hpos[posn2];
+      hpos[posn1] = tile2;
+      hpos[posn2] = tile1;
+      wpos[tile1] = posn2;
+      wpos[tile2] = posn1;
+   }
+   double memory() const { return 2.0 * sizeof(T) * wpos.size(); }               //  bytes used
+};
+
+puzzle_state<uint32>    pstate;                                                  //  tile positions
+vector<uint8>        Tdirty;                                                     //  window tile needs redraw on board
+vector<uint>         Tvisit;                                                     //  swap3 cluster: tile visited if = Vgen
+vector<int>          Tqueue;                                                     //  swap3 cluster: tile positions
+uint                 Vgen = 0;                                                   //  swap3 cluster generation
+vector<int>          Mtiles;                                                     //  misplaced home tiles, any order
+vector<int>          Mposn;                                                      //  position in Mtiles, -1 if home
+vector<int>          Gsel;                                                       //  window positions of selected group
+
+vector<uint32>       Gnode;                                                      //  joined tile groups (union-find):
+vector<uint32>       Gparent;                                                    //    node of home tile, parent node
+vector<uint32>       Gsize;                                                      //  group size, valid for root node
+vector<uint32>       Gcount;                                                     //  count of groups of each size
+int                  Njoined = 0;                                                //  tiles joined to another tile
+int                  Gmax = 0;                                                   //  largest group size
+
+#define     Jmax 65536                                                           //  move journal size (swaps)
+#define     Jstart 0x80000000                                                    //  flag: 1st swap of an action
+uint32      Jposn[Jmax][2];                                                      //  ring buffer of swapped positions
+int64       Jfirst = 0, Jend = 0, Jtop = 0;                                      //  oldest, next, redo limit (seq. no.)
+int         Jaction = 1;                                                         //  next swap starts a new action
+int         Jskip = 0;                                                           //  action too big, not journaled
+int         Jreplay = 0;                                                         //  undo/redo in progress
+
+#define     edgeK 8                                                              //  best partners kept per tile side
+
+struct edge_index_t {                                                            //  tile edge compatibility, from pixels
+   int               Nt = 0, K = 0;                                              //  tiles, partners per side
+   int               tw = 0, th = 0;                                             //  tile size
+   int               Lcc[4];                                                     //  feature bytes per side (16*N)
+   vector<uint8>     edge[4];                                                    //  [tile*Lcc] edge pixels per side
+   vector<uint8>     pred[4];                                                    //  [tile*Lcc] pixels predicted beyond
+   vector<uint32>    score;                                                      //  [(tile*4+side)*K] best, ascending
+   vector<int>       partner;                                                    //  [(tile*4+side)*K] tiles, -1 = none
+};
+
+struct hint_job_t {                                                              //  edge index build in background
+   edge_index_t      ex;
+   cairo_surface_t   *surf;                                                      //  window image, referenced
+   int               Nr, Nc, tw, th;
+   volatile int      stop;                                                       //  obsolete, stop early
+};
+
+//  Saved puzzle file, binary format, all numbers little-endian:
+//    header, image file name (Lpath bytes, zero padded to hsize),
+//    tile positions, encoding given in header:
+//      puz_flat: uint32 window position of each home tile [Ntiles]
+//      puz_sparse: misplaced tiles only, as varints: count, then for
+//        each tile ascending: tile - prior tile - 1, zigzag(posn - tile)
+//      puz_deflate: puz_sparse, deflate compressed (bsize before)
+//    uint64 checksum = zhash64() of all prior bytes.
+//  Version 1 files are puz_flat only, and are still written for puz_flat.
+//  Older text files are still accepted by puzzle_read_text().
+
+#define     puz_magic "PICPUZ\x1a\n"                                            //  8 bytes, not a text file
+#define     puz_version 2                                                        //  newest version
+#define     puz_flat 0                                                           //  tile position encodings
+#define     puz_sparse 1
+#define     puz_deflate 2
+#define     puz_maxtiles (1 << 24)                                               //  sanity limit, sparse file is small
+
+struct puz_header_t {                                                            //  64 bytes
+   char        magic[8];
+   uint32      version;
+   uint32      hsize;                                                            //  header + file name, multiple of 8
+   uint32      Nrows, Ncols;
+   uint32      tileU, tileW, tileH;                                              //  tile size setpoint, actual
+   uint32      Nhome;
+   uint64      imagehash;                                                        //  zhash64() of image file, 0 = none
+   uint32      Lpath;                                                            //  image file name length
+   uint32      encoding;                                                         //  tile positions: puz_flat ...
+   uint32      bsize;                                                            //  tile positions bytes, not deflated
+   uint32      spare;
+};
 
-struct tileposn_t {
-   int      row, col;                                                            //  map tile position
+string      puz_error;                                                           //  why puzzle_read() failed
+
+//  Autosave: a checkpoint file (binary puzzle format) and a journal of
+//  the swaps made since, written by a background thread. See autosave_timer().
+
+#define     ASjmagic "PICPUZJ\n"                                                 //  journal file magic
+
+struct autosave_job_t {                                                          //  one batch for the writer thread
+   vector<uint8>     ckpt;                                                       //  checkpoint file image, or empty
+   vector<uint32>    swaps;                                                      //  swapped window positions, pairs
+   int               remove;                                                     //  no puzzle: remove files
 };
-vector<tileposn_t>   wposn;                                                         //  window position of home tile
-vector<tileposn_t>   hposn;                                                         //  home position of window tile
+
+string               ASfile, ASjfile;                                            //  checkpoint and journal files
+autosave_job_t       ASjob;                                                      //  batch owned by writer if busy
+vector<uint32>       ASswaps;                                                    //  swaps not yet handed to writer
+volatile int         ASbusy = 0;                                                 //  writer thread is running
+int                  ASfull = 1;                                                 //  next batch is a checkpoint
+int                  ASsaved = 0;                                                //  files may exist
+int64                ASjsize = 0;                                                //  swaps journaled since checkpoint
+int                  ASjfd = -1;                                                 //  journal file, writer thread
+uint64               AScsum = 0;                                                 //  checksum of checkpoint file
+int                  AStimer = 0;                                                //  batch timer
+
+edge_index_t         Eindex;                                                     //  edge index of current puzzle
+hint_job_t           *Hjob = 0;                                                  //  pending edge index build
+int                  hintP1 = -1, hintP2 = -1;                                   //  hint tiles shown, window posn.
 
 void m_open(const string& file);                                                         //  open image for new puzzle
 void m_tile();                                                                   //  set new tile size
@@ -76,7 +294,24 @@ void m_show();
 void m_save();                                                                   //  save puzzle for later
 void m_resume();                                                                 //  resume saved puzzle
 void m_doN(int N);                                                               //  move tiles home
+int  puzzle_write(cchar *file);                                                  //  save puzzle, binary format
+void puzzle_encode(vector<uint8> &buff, uint64 ihash, int pack);                 //  binary file image of puzzle
+void puzzle_sparse(vector<uint8> &body);                                         //  misplaced tile positions, varints
+int  zlib_convert(int inflate, const uint8 *data, size_t cc, vector<uint8> &out, size_t outcc);
+int  puzzle_read(cchar *file, string &image, uint64 &ihash, int &Nfix);          //  load saved puzzle, any format
+int  puzzle_read_binary(const uint8 *data, size_t size, string &image, uint64 &ihash);
+int  puzzle_read_text(const uint8 *data, size_t size, string &image);           //  load older text format
+int  puzzle_invalid(cchar *format, ...);                                         //  set puz_error, return 2
+uint64 image_hash(cchar *file);                                                  //  content hash of image file
+void autosave_start();                                                           //  start autosave timer
+void autosave_stop();                                                            //  clean exit, remove autosave
+void autosave_swap(int ii1, int ii2);                                            //  autosave a swap
+void autosave_checkpoint();                                                      //  autosave whole puzzle next
+int  autosave_restore();                                                         //  restore after crash
 void m_line();                                                                   //  change tile border lines
+void m_undo();                                                                   //  undo last action
+void m_redo();                                                                   //  redo undone action
+void m_hint();                                                                   //  suggest a move
 void m_quit();                                                                   //  exit application
 void m_help();                                                                   //  display help file
 
@@ -84,17 +319,60 @@ int  gtkinitfunc(void *data);
 void winpaint(GtkWidget *, cairo_t *);                                           //  window paint function
 void menufunc(GtkWidget *, const char *menu);                                    //  menu processor
 void destroyfunc();                                                              //  window destroy signal function
+int  KBpress(GtkWidget *, GdkEventKey *);                                        //  keyboard shortcuts
 int  puzzle_status();                                                            //  test puzzle status
 void drag_drop(int x, int y, const char *file);                                        //  drag/drop event handler   v.2.4
 void init_puzzle(int init);                                                      //  initialize puzzle
 void clear_puzzle();                                                             //  release memory, set no puzzle
+void free_refimage();                                                            //  scaled reference image obsolete
 void tile_window(int init);                                                      //  paint tiles to window
+cairo_surface_t * window_image(PIXBUF *pxb, int ww, int hh, int fast);          //  scale image for window
+void set_window_image(cairo_surface_t *surf);                                    //  new window image, tile atlas
 void mouse_event(GtkWidget *, GdkEventButton *);                                 //  handle mouse clicks
 void swap_tiles(int row1, int col1, int row2, int col2);                         //  swap two tiles
+void move_tiles(const int *posns, const int *tiles, int N, int journal);         //  rearrange many tiles at once
+void damage_tiles(const int *posns, int N);                                      //  queue repaint for many tiles
+void group_select(int row, int col);                                             //  select joined group of tile
+int  group_move(int drow, int dcol);                                             //  move selected group
+void visit_new(int Ngen = 1);                                                    //  new visited tiles generation(s)
+void mix_tiles();                                                                //  random permutation of all tiles
+void mix_tiles_target(int Nmis, double dist, int Njoin);                         //  mix to a target difficulty
+void mix_stats(int &Nmis, double &dist, int &Njoin);                             //  difficulty of current board
+void journal_action();                                                           //  next swaps are a new action
+void journal_add(int ii1, int ii2);                                              //  add swap to journal
+void journal_clear();                                                            //  forget all moves
+void misplaced_init();                                                           //  find all misplaced tiles
+void groups_init();                                                              //  find all joined tile groups
+void groups_split(const vector<int> &seeds);                                     //  groups after joins were broken
+int  group_find(int tile);                                                       //  group root node of tile
+int  joined(int posn1, int posn2);                                               //  tiles fit together
+void misplaced_update(int ii);                                                   //  update misplaced set for tile
 void draw_tile(int row, int col);                                                //  draw tile at window position
+void damage_tile(int row, int col);                                              //  queue window repaint for tile
+void redraw_all();                                                               //  redraw all tiles at next paint
+void build_atlas();                                                              //  pre-render all tiles
+void free_atlas();                                                               //  release tile atlas
+void build_pyramid();                                                            //  start image pyramid build thread
+void free_pyramid();                                                             //  stop thread, release image levels
+PIXBUF * image_level(int ww, int hh);                                            //  smallest image level >= ww x hh
+void anim_begin(int step(int), int Nsteps, double secs);                         //  start tile animation
+void anim_finish();                                                              //  do remaining animation steps
+void anim_stop();                                                                //  cancel animation
 void stbar_update();                                                             //  update status bar
 void save_imagedirk();                                                           //  save image directory on exit
 void load_imagedirk();                                                           //  reload upon next startup
+int  m_bench(int argc, char *argv[]);                                            //  benchmarks, no GUI
+int  m_render(int argc, char *argv[]);                                           //  render board to PNG file, no GUI
+int  m_solve(int argc, char *argv[]);                                            //  solve from pixels, no GUI
+void edge_index_build(edge_index_t &ex, cairo_surface_t *surf,                   //  find best partners of tile sides
+                      int Nr, int Nc, int tw, int th, int K, volatile int *stop = 0,
+                      const int *names = 0);
+void edge_index_start();                                                         //  build edge index in background
+void edge_index_free();                                                          //  stop build, discard edge index
+int  hint_swap(int &posn1, int &posn2);                                          //  best swap from edge index
+void hint_show(int posn1, int posn2);                                            //  outline hint tiles, -1 = none
+uint32 edge_score(const edge_index_t &ex, int tile1, int side, int tile2);       //  tile2 fit on side of tile1
+void solve_tiles(const edge_index_t &ex, int Nr, int Nc, int *place);           //  tile arrangement from edge index
 
 
 //  main program
@@ -103,6 +381,15 @@ int main(int argc, char *argv[])
 {
    string        lang;
 
+   if (argc > 1 && strmatch(argv[1],"-bench"))                                   //  -bench (benchmarks, no GUI)
+      return m_bench(argc-2,argv+2);
+
+   if (argc > 1 && strmatch(argv[1],"--render"))                                 //  --render (PNG file, no GUI)
+      return m_render(argc-1,argv+1);
+
+   if (argc > 1 && strmatch(argv[1],"--solve"))                                  //  --solve (from pixels, no GUI)
+      return m_solve(argc-1,argv+1);
+
    gtk_init(&argc, &argv);                                                       //  GTK command line options
 
    zinitapp("picpuz");                                                           //  set up app directories
@@ -117,6 +404,8 @@ int main(int argc, char *argv[])
             imagedirk = argv[++ii];
       else if (strmatch(argv[ii],"-f") && argc > ii+1)                           //  -f imageFile
             clfile = argv[++ii];
+      else if (strmatch(argv[ii],"-a") && argc > ii+1)                           //  -a animation secs (0 = instant)
+            animtime = atof(argv[++ii]);
       else clfile = argv[ii];                                              //  assume imageFile
    }
 
@@ -140,6 +429,9 @@ int main(int argc, char *argv[])
    add_toolbar_button(tbar,ZTX("resume"),ZTX("resume saved puzzle"),"open.png",menufunc);
    add_toolbar_button(tbar,ZTX("do 1"),ZTX("move one tile home"),"piece.png",menufunc);
    add_toolbar_button(tbar,ZTX("do 8"),ZTX("move eight tiles home"),"piece.png",menufunc);
+   add_toolbar_button(tbar,ZTX("undo"),ZTX("undo last move (Ctrl+Z)"),"undo.png",menufunc);
+   add_toolbar_button(tbar,ZTX("redo"),ZTX("redo undone move (Ctrl+Y)"),"redo.png",menufunc);
+   add_toolbar_button(tbar,ZTX("hint"),ZTX("suggest a move"),"hint.png",menufunc);
    add_toolbar_button(tbar,ZTX("line"),ZTX("change tile border line"),"line.png",menufunc);
    add_toolbar_button(tbar,ZTX("quit"),ZTX("quit picpuz"),"quit.png",menufunc);
    add_toolbar_button(tbar,ZTX("help"),ZTX("view help document"),"help.png",menufunc);
@@ -155,6 +447,7 @@ int main(int argc, char *argv[])
    G_SIGNAL(dwin1,"button-release-event",mouse_event,0);
    G_SIGNAL(dwin1,"draw",winpaint,0);                                            //  gtk3
    G_SIGNAL(win1,"destroy",destroyfunc,0);
+   G_SIGNAL(win1,"key-press-event",KBpress,0);
 
    drag_drop_connect(dwin1,drag_drop);                                           //  connect drag-drop event      v.2.4
 
@@ -163,6 +456,7 @@ int main(int argc, char *argv[])
 
    g_timeout_add(0,gtkinitfunc,0);                                               //  setup initz. call         gtk3
    gtk_main();                                                                   //  process window events
+   autosave_stop();                                                              //  clean exit
    return 0;
 }
 
@@ -177,6 +471,8 @@ int gtkinitfunc(void *)
 
    if (imagedirk.length() == 0) load_imagedirk();                                           //  get image directory   v.1.8
 
+   autosave_start();
+
    if (clfile.length()) {                                                                //  command line image file
       string p;
       if (clfile[0] != '/') {
@@ -188,6 +484,7 @@ int gtkinitfunc(void *)
 
       m_open(p);                                                                //  open command line file
    }
+   else autosave_restore();                                                      //  puzzle of crashed session
 
    return 0;
 }
@@ -197,10 +494,47 @@ int gtkinitfunc(void *)
 
 void winpaint(GtkWidget *, cairo_t *cr)
 {
-   mwcr = cr;                                                                    //  gtk3
-   cairo_set_line_width(mwcr,1);
-   if (Ntiles) tile_window(0);                                                   //  paint tiles
-   mwcr = 0;
+   double   x1, y1, x2, y2;
+   int      row, col, row1, col1, row2, col2, ii;
+
+   if (! Ntiles) return;
+
+   if (gtk_widget_get_allocated_width(dwin1) != allocW                           //  window resized,
+    || gtk_widget_get_allocated_height(dwin1) != allocH) tile_window(2);         //    rescale image and tiles
+   if (! board) return;
+
+   if (Ndirty)                                                                   //  redraw changed tiles on board,
+   {                                                                             //    only those within exposed area
+      cairo_clip_extents(cr,&x1,&y1,&x2,&y2);
+      col1 = int(x1) / tileW;
+      col2 = (int(x2) - 1) / tileW + 1;                                          //  + lobe from tile to right
+      row1 = int(y1) / tileH;
+      row2 = (int(y2) - 1) / tileH;
+      if (col2 > Ncols-1) col2 = Ncols-1;
+      if (row2 > Nrows-1) row2 = Nrows-1;
+
+      for (row = row1; row <= row2; row++)
+      for (col = col1; col <= col2; col++)
+      {
+         ii = Tindex(row,col);
+         if (! Tdirty[ii]) continue;
+         draw_tile(row,col);
+         Tdirty[ii] = 0;
+         Ndirty--;
+      }
+   }
+
+   cairo_set_source_surface(cr,board,0,0);                                       //  copy board image to window,
+   cairo_paint(cr);                                                              //    clipped to exposed area
+
+   if (hintP1 >= 0) {                                                            //  outline hint tiles
+      cairo_set_source_rgb(cr,1,0.8,0);
+      cairo_set_line_width(cr,3);
+      cairo_rectangle(cr,hintP1 % Ncols * tileW + 1.5,hintP1 / Ncols * tileH + 1.5,tileW-3,tileH-3);
+      cairo_rectangle(cr,hintP2 % Ncols * tileW + 1.5,hintP2 / Ncols * tileH + 1.5,tileW-3,tileH-3);
+      cairo_stroke(cr);
+   }
+
    return;
 }
 
@@ -217,6 +551,9 @@ void menufunc(GtkWidget *, const char *menu)
    if (strmatch(menu,"resume")) m_resume();
    if (strmatch(menu,"do 1")) m_doN(1);
    if (strmatch(menu,"do 8")) m_doN(8);
+   if (strmatch(menu,"undo")) m_undo();
+   if (strmatch(menu,"redo")) m_redo();
+   if (strmatch(menu,"hint")) m_hint();
    if (strmatch(menu,"line")) m_line();
    if (strmatch(menu,"quit")) m_quit();
    if (strmatch(menu,"help")) m_help();
@@ -243,6 +580,7 @@ void m_open(const std::string& file)
    }
 
    imagefile = newfile;
+   free_refimage();                                                              //  reference image obsolete
 
    imagedirk = imagefile;                                                  //  set new image directory
    std::size_t found = imagedirk.find_last_of("/");
@@ -289,29 +627,251 @@ void m_tile()
    if (nn == tileU) return;                                                      //  no change
 
    tileU = nn;                                                                   //  new setpoint tile size
+   anim_stop();
    tile_window(1);                                                               //  initialize puzzle
 
    return;
 }
 
 
-//  mix-up the tiles
+//  mix-up the tiles: all at random, or to a difficulty level
+//  easy/medium/hard: misplaced tiles %, mean distance from home (tiles),
+//  misplaced tiles % in joined pairs
 
 void m_mix()
 {
+   static int     level = 0, pmis = 50, pjoin = 20;                              //  last choice
+   static double  dist = 3;
+   int            presets[3][3] = { { 30, 2, 30 }, { 60, 4, 10 }, { 100, 10, 0 } };
+   cchar          *names[5] = { "all", "easy", "medium", "hard", "custom" };
+   int            ii, nn, zstat;
+
+   anim_finish();                                                                //  complete prior animation
+   if (! Ntiles) return;
    if (puzzle_status()) return;                                                  //  do not discard
 
-   for (int row1 = 0; row1 < Nrows; row1++)                                          //  randomize tile positions
-   for (int col1 = 0; col1 < Ncols; col1++)
+   zdialog *zd = zdialog_new(ZTX("mix tiles"),win1,"OK",ZTX("cancel"),nullptr);
+   zdialog_add_widget(zd,"vbox","vb1","dialog",0,"space=5");
+   zdialog_add_widget(zd,"radio","all","vb1",ZTX("all tiles, random"));
+   zdialog_add_widget(zd,"radio","easy","vb1",ZTX("easy"));
+   zdialog_add_widget(zd,"radio","medium","vb1",ZTX("medium"));
+   zdialog_add_widget(zd,"radio","hard","vb1",ZTX("hard"));
+   zdialog_add_widget(zd,"radio","custom","vb1",ZTX("custom"));
+   zdialog_add_widget(zd,"hbox","hb1","dialog",0,"space=3");
+   zdialog_add_widget(zd,"label","lb1","hb1",ZTX("misplaced tiles %"),"space=10");
+   zdialog_add_widget(zd,"spin","pmis","hb1","1|100|1|50");
+   zdialog_add_widget(zd,"hbox","hb2","dialog",0,"space=3");
+   zdialog_add_widget(zd,"label","lb2","hb2",ZTX("mean distance from home"),"space=10");
+   zdialog_add_widget(zd,"spin","dist","hb2","1|999|0.5|3");
+   zdialog_add_widget(zd,"hbox","hb3","dialog",0,"space=3");
+   zdialog_add_widget(zd,"label","lb3","hb3",ZTX("tiles in joined pairs %"),"space=10");
+   zdialog_add_widget(zd,"spin","pjoin","hb3","0|100|1|20");
+   zdialog_stuff(zd,names[level],1);
+   zdialog_stuff(zd,"pmis",pmis);
+   zdialog_stuff(zd,"dist",dist);
+   zdialog_stuff(zd,"pjoin",pjoin);
+
+   zdialog_run(zd);
+   zstat = zdialog_wait(zd);
+
+   for (ii = 0; ii < 5; ii++) {
+      zdialog_fetch(zd,names[ii],nn);
+      if (nn) level = ii;
+   }
+   zdialog_fetch(zd,"pmis",pmis);
+   zdialog_fetch(zd,"dist",dist);
+   zdialog_fetch(zd,"pjoin",pjoin);
+   zdialog_free(zd);
+   if (zstat != 1) return;                                                       //  cancel
+
+   if (level == 0) mix_tiles();                                                  //  randomize tile positions
+   else if (level == 4)
+      mix_tiles_target(Ntiles * pmis / 100,dist,Ntiles * pmis / 100 * pjoin / 200);
+   else {
+      int *pp = presets[level-1];
+      mix_tiles_target(Ntiles * pp[0] / 100,pp[1],Ntiles * pp[0] / 100 * pp[2] / 200);
+   }
+
+   stbar_update();
+   return;
+}
+
+
+//  Fisher-Yates shuffle: all tile permutations are equally likely.
+//  Tiles are placed in one batch, not by swap_tiles(), so no clusters
+//  are moved home while mixing.
+
+void mix_tiles()
+{
+   vector<int>    posns(Ntiles), tiles(Ntiles);
+
+   for (int ii = 0; ii < Ntiles; ii++) posns[ii] = tiles[ii] = ii;
+
+   for (int ii = Ntiles-1; ii > 0; ii--)
+      std::swap(tiles[ii],tiles[lrand(rseed,ii+1)]);
+
+   move_tiles(&posns[0],&tiles[0],Ntiles,0);
+   return;
+}
+
+
+//  Mix with a target difficulty, starting from the solved board:
+//    Nmis   misplaced tiles
+//    dist   mean distance of a misplaced tile from home (rows + cols)
+//    Njoin  pairs of misplaced tiles that are already joined
+//  The board is divided in square blocks with a random offset, sized so
+//  that two random points in a block are dist apart on average. Blocks
+//  are visited in random order and get a share of Njoin tile pairs
+//  (horizontal dominos), then of the Nmis - 2 * Njoin single tiles, at
+//  random positions in the block, at least 2 or none. The dominos of a
+//  block are shuffled and each one moves to the slot of the next (one
+//  cycle, so none stays home), the singles likewise. Joins made by chance
+//  (any side of a moved tile, domino tiles too) are broken by exchanging
+//  the single or domino with a nearby one. Cost is O(N), seeded from rseed.
+
+void mix_tiles_target(int Nmis, double dist, int Njoin)
+{
+   vector<int>    posns(Ntiles), tiles(Ntiles), border, cells;
+   vector<uint8>  used(Ntiles,0);                                                //  1 = single, 2/3 = domino left/right
+   int            ii, kk, posn, row, col, Ndoms = 0;
+
+   if (Nmis > Ntiles) Nmis = Ntiles;
+   if (Njoin > Nmis / 2) Njoin = Nmis / 2;
+   if (Njoin < 0) Njoin = 0;
+   if (dist < 1) dist = 1;
+
+   for (ii = 0; ii < Ntiles; ii++) posns[ii] = tiles[ii] = ii;
+
+   int B = int((3 * dist + sqrt(9 * dist * dist + 16)) / 4 + 0.5);               //  mean |a-b| in B x B = dist
+   if (B < 2) B = 2;
+   int offr = lrand(rseed,B), offc = lrand(rseed,B);                             //  random block grid offset
+   int Bcols = (Ncols + offc) / B + 1;
+   int Nblocks = ((Nrows + offr) / B + 1) * Bcols;
+
+   for (ii = 0; ii < Nblocks; ii++) border.push_back(ii);                        //  random block order
+   for (ii = Nblocks-1; ii > 0; ii--)
+      std::swap(border[ii],border[lrand(rseed,ii+1)]);
+
+   for (int dom = 1; dom >= 0; dom--)                                            //  dominos, then singles
+   {
+      int need = dom ? Njoin : Nmis - 2 * Ndoms;
+      double per = dom ? 2.0 * need / Ntiles : 1.0 * need / (Ntiles - 2 * Ndoms); //  per cell
+      if (per > 1) per = 1;
+
+      for (int pass = 0; pass < 8 && need > 1; pass++)                           //  until enough
+      for (ii = 0; ii < Nblocks && need > 1; ii++)
+      {
+         int row1 = border[ii] / Bcols * B - offr, row2 = row1 + B;
+         int col1 = border[ii] % Bcols * B - offc, col2 = col1 + B;
+         if (row1 < 0) row1 = 0;
+         if (col1 < 0) col1 = 0;
+         if (row2 > Nrows) row2 = Nrows;
+         if (col2 > Ncols) col2 = Ncols;
+
+         double want = per * (row2 - row1) * (col2 - col1) / (dom ? 2 : 1);     //  share of block, random round
+         int Ng = int(want);
+         if (drand(rseed,1.0) < want - Ng) Ng++;
+         if (Ng == 0) continue;
+         if (Ng < 2) Ng = 2;
+         if (Ng > need) Ng = need;
+         if (need - Ng == 1) Ng++;                                               //  do not leave one alone
+
+         cells.clear();                                                          //  free cells (domino: + right)
+         for (row = row1; row < row2; row++)
+         for (col = col1; col < col2 - dom; col++) {
+            posn = Tindex(row,col);
+            if (! used[posn] && ! (dom && used[posn+1])) cells.push_back(posn);
+         }
+
+         int Nc = 0;                                                             //  pick Ng at random
+         for (kk = 0; kk < (int) cells.size() && Nc < Ng; kk++) {
+            std::swap(cells[kk],cells[kk + lrand(rseed,cells.size() - kk)]);
+            posn = cells[kk];
+            if (used[posn] || (dom && used[posn+1])) continue;
+            used[posn] = dom ? 2 : 1;
+            if (dom) used[posn+1] = 3;
+            cells[Nc++] = posn;                                                  //  group = cells[0..Nc-1]
+         }
+
+         if (Nc < 2) {                                                           //  block is full
+            for (kk = 0; kk < Nc; kk++) {
+               used[cells[kk]] = 0;
+               if (dom) used[cells[kk]+1] = 0;
+            }
+            continue;
+         }
+
+         for (kk = 0; kk < Nc; kk++) {                                           //  tile at cells[kk] to next slot
+            int posn2 = cells[(kk+1) % Nc];
+            tiles[posn2] = cells[kk];
+            if (dom) tiles[posn2+1] = cells[kk] + 1;
+         }
+
+         need -= Nc;
+         if (dom) Ndoms += Nc;
+      }
+   }
+
+   auto chance = [&](int posn) -> int {                                          //  moved tile at posn is joined
+      int tile = tiles[posn];                                                    //    to a neighbor by chance
+      if (tile == posn) return 0;                                                //    (not its domino partner)
+      int col = posn % Ncols, tcol = tile % Ncols;
+      if (col < Ncols-1 && tcol < Ncols-1 && tiles[posn+1] == tile+1 && used[posn] != 2) return 1;
+      if (col > 0 && tcol > 0 && tiles[posn-1] == tile-1 && used[posn] != 3) return 1;
+      if (posn + Ncols < Ntiles && tiles[posn+Ncols] == tile+Ncols) return 1;
+      if (posn >= Ncols && tiles[posn-Ncols] == tile-Ncols) return 1;
+      return 0;
+   };
+
+   for (int pass = 0; pass < 4; pass++)                                          //  break chance joins
    {
-      int row2 = lrand(rseed,Nrows);
-      int col2 = lrand(rseed,Ncols);
-      swap_tiles(row1,col1,row2,col2);
-      zsleep(0.01);
-      zmainloop();
+      int Nfound = 0;
+      for (posn = 0; posn < Ntiles; posn++)
+      {
+         if (! chance(posn)) continue;
+         Nfound++;
+         int posn1 = posn - (used[posn] == 3);                                   //  single or domino left
+         int dom = (used[posn1] == 2);
+         for (int tries = 0; tries < 8; tries++) {                               //  exchange with a single or
+            row = posn1 / Ncols + lrand(rseed,2*B+1) - B;                        //    domino within block distance
+            col = posn1 % Ncols + lrand(rseed,2*B+1) - B;
+            if (row < 0 || row >= Nrows || col < 0 || col >= Ncols) continue;
+            int posn2 = Tindex(row,col);
+            if (used[posn2] != used[posn1] || posn2 == posn1) continue;
+            if (tiles[posn2] == posn1 || tiles[posn1] == posn2) continue;        //  would go home
+            for (kk = 0; kk <= dom; kk++) std::swap(tiles[posn1+kk],tiles[posn2+kk]);
+            int join = 0;
+            for (kk = 0; kk <= dom; kk++) join |= chance(posn1+kk) | chance(posn2+kk);
+            if (! join) break;
+            for (kk = 0; kk <= dom; kk++) std::swap(tiles[posn1+kk],tiles[posn2+kk]);  //  undo, new joins
+         }
+      }
+      if (! Nfound) break;
    }
 
-   stbar_update();                                                               //  update status bar
+   move_tiles(&posns[0],&tiles[0],Ntiles,0);
+   return;
+}
+
+
+//  get the difficulty of the current board, as set by mix_tiles_target()
+
+void mix_stats(int &Nmis, double &dist, int &Njoin)
+{
+   double   sum = 0;
+
+   Nmis = Njoin = 0;
+   for (int posn = 0; posn < Ntiles; posn++)
+   {
+      int tile = pstate.hposn(posn);
+      if (tile == posn) continue;
+      Nmis++;
+      sum += abs(posn / Ncols - tile / Ncols) + abs(posn % Ncols - tile % Ncols);
+      if (joined(posn,posn+1)) Njoin++;
+      if (joined(posn,posn+Ncols)) Njoin++;
+   }
+
+   dist = Nmis ? sum / Nmis : 0;
    return;
 }
 
@@ -358,17 +918,30 @@ void win2_paint(GtkWidget *, cairo_t *cr)
    int y = int(1.0 * winx * imageH / imageW);
    if (winy > y) winy = y;
 
-   PIXBUF *refPixbuf = gdk_pixbuf_scale_simple(iPixbuf,winx,winy,interp);                //  scale image to window
-   gdk_cairo_set_source_pixbuf(cr,refPixbuf,0,0);                                //  gtk3
-   cairo_paint(cr);
-   g_object_unref(refPixbuf);
+   if (! refSurface || cairo_image_surface_get_width(refSurface) != winx         //  window size changed,
+                    || cairo_image_surface_get_height(refSurface) != winy)       //    scale image to window
+   {
+      free_refimage();
+      refSurface = window_image(image_level(winx,winy),winx,winy,0);
+      if (! refSurface) return;
+   }
 
+   cairo_set_source_surface(cr,refSurface,0,0);                                  //  paint cached image
+   cairo_paint(cr);
    return;
 }
 
 void win2_destroy()
 {
    win2 = 0;
+   free_refimage();
+   return;
+}
+
+void free_refimage()                                                             //  scaled image obsolete
+{
+   if (refSurface) cairo_surface_destroy(refSurface);
+   refSurface = 0;
    return;
 }
 
@@ -387,26 +960,11 @@ void m_save()
    sfile = zgetfile(ZTX("save puzzle to a file"),MWIN,"save",savefile.c_str());
    if (sfile.empty()) return;
 
-   FILE* fid = fopen(sfile.c_str(), "w");
-   if (! fid) {
+   if (puzzle_write(sfile.c_str())) {
       zmessageACK(win1,ZTX("cannot open: %s"),sfile.c_str());
       return;
    }
 
-   fprintf(fid,"%s \n",imagefile.c_str());                                               //  save image file
-   fprintf(fid," %d %d \n",Ntiles,Nhome);                                        //  save tile count and no. home
-   fprintf(fid," %d %d \n",Nrows,Ncols);                                         //  save row and col counts
-
-   for (int row = 0; row < Nrows; row++) {                                           //  save tile position data
-      for (int col = 0; col < Ncols; col++) {
-         int ii = Tindex(row,col);
-         fprintf(fid," %d,%d ",wposn[ii].row, wposn[ii].col);
-      }
-      fprintf(fid,"\n");
-   }
-
-   fclose(fid);
-
    Nmoves = 0;                                                                   //  reset move count
    return;
 }
@@ -416,9 +974,9 @@ void m_save()
 
 void m_resume()
 {
-   FILE        *fid;
-   int         row2, col2;
-   string      newfile;
+   string      newfile, image;
+   uint64      ihash, ihash2;
+   int         Nfix;
 
    if (puzzle_status()) return;                                                  //  do not discard
    clear_puzzle();
@@ -426,649 +984,3518 @@ void m_resume()
    newfile = zgetfile(ZTX("load puzzle from file"),MWIN,"file",get_zuserdir());
    if (newfile.empty()) return;
 
-   fid = fopen(newfile.c_str(),"r");
-   if (! fid) {
+   int stat = puzzle_read(newfile.c_str(),image,ihash,Nfix);
+   if (stat == 1) {
       zmessageACK(win1,ZTX("cannot open: %s"),newfile.c_str());
       return;
    }
-
-   newfile.resize(XFCC);
-   const char* pp = fgets_trim(&newfile[0],newfile.length(), fid, 1);                                        //  read image file name
-   if (! pp) {
-	   goto badfile;
+   if (stat) {
+      zmessageACK(win1,"%s\n %s",ZTX("saved puzzle file is not valid"),puz_error.c_str());
+      clear_puzzle();
+      return;
+   }
+   if (Nfix)                                                                     //  damaged file, repaired
+      zmessageACK(win1,ZTX("saved puzzle file is damaged, %d tiles were moved"),Nfix);
+
+   ihash2 = image_hash(image.c_str());                                           //  image file edited or replaced
+   if (ihash && ihash2 && ihash2 != ihash) {                                     //    (missing: init_puzzle() fails)
+      if (! zmessageYN(win1,ZTX("image file has changed since the puzzle was saved:\n %s \n continue?"),
+                                                                        image.c_str())) {
+         clear_puzzle();
+         return;
+      }
    }
-   else {
-		imagefile = newfile;
-
-		int stat = fscanf(fid," %d %d ",&Ntiles,&Nhome);
-		if (stat != 2) goto badfile;
 
-		stat = fscanf(fid," %d %d ",&Nrows,&Ncols);                                   //  read row and col counts
-		if (stat != 2) goto badfile;
-		if (Ntiles != Nrows * Ncols) goto badfile;
+   imagefile = image;
+   free_refimage();                                                              //  reference image obsolete
+   init_puzzle(0);                                                               //  initialize, preserve tile data
+   return;
+}
 
-		wposn.clear();
-		wposn.resize(Ntiles);
 
-		for (int row1 = 0; row1 < Nrows; row1++) {                                        //  read tile position data
-		   for (int col1 = 0; col1 < Ncols; col1++) {
-			  stat = fscanf(fid," %d,%d ",&row2,&col2);
-			  if (stat != 2) goto badfile;
-			  if (row2 < 0 || row2 >= Nrows) goto badfile;
-			  if (col2 < 0 || col2 >= Ncols) goto badfile;
-			  int ii = Tindex(row1,col1);
-			  wposn[ii].row = row2;
-			  wposn[ii].col = col2;
-		   }
-		}
+//  write puzzle to a file in binary format: header, image file name
+//  and tile positions (1 MB for 250k tiles), all or nothing
+//  returns 0 = OK, else errno
 
-		fclose(fid);
+int puzzle_write(cchar *file)
+{
+   vector<uint8>  buff;
 
-		init_puzzle(0);                                                               //  initialize, preserve tile data
-		return;
-   }
-badfile:
-   fclose(fid);
-   zmessageACK(win1,ZTX("saved puzzle file is not valid"));
-   clear_puzzle();
-   return;
+   puzzle_encode(buff,image_hash(imagefile.c_str()),2);
+   return zwrite_atomic(file,&buff[0],buff.size());
 }
 
 
-//  move tiles into place automatically
+//  binary puzzle file image of the current puzzle, ihash = image hash or 0
+//  pack = 0: flat tile positions, O(Ntiles)
+//         1: sparse if smaller, from Mtiles, O(misplaced tiles)
+//         2: sparse and deflate if smaller
 
-void m_doN(int nn1)
+void puzzle_encode(vector<uint8> &buff, uint64 ihash, int pack)
 {
-   if (! Ntiles) return;
-
-   while (true)
-   {
-      int row1 = lrand(rseed,Nrows);                                                 //  random starting tile
-      int col1 = lrand(rseed,Ncols);
-		int row2, col2;
-      int nn2 = Ntiles;
-
-      while (true)                                                               //  scan for tile to move
-      {
-         int ii = Tindex(row1,col1);
-         row2 = wposn[ii].row;                                                   //  curr. position
-         col2 = wposn[ii].col;
-         if (row1 != row2 || col1 != col2) break;                                //  not at home position
-         if (--nn2 == 0) goto mdone;
-         if (++col1 < Ncols) continue;                                           //  look at next tile
-         col1 = 0;
-         if (++row1 < Nrows) continue;
-         row1 = 0;
+   puz_header_t   head;
+   vector<uint8>  body, zbody;
+   int            encoding = puz_flat;
+   int            Lpath = imagefile.length();
+   size_t         hsize = (sizeof(head) + Lpath + 7) & ~size_t(7);
+   size_t         bsize = 4 * (size_t) Ntiles, size;
+
+   if (pack && 2 * Mtiles.size() < (size_t) Ntiles) {                            //  near solved, try sparse
+      puzzle_sparse(body);
+      if (body.size() < bsize) {
+         encoding = puz_sparse;
+         bsize = body.size();
       }
+   }
 
-      swap_tiles(row1,col1,row2,col2);                                           //  move tile home
-      zsleep(0.02);
-      zmainloop();
-      if (--nn1 == 0) goto mdone;
+   if (encoding == puz_sparse && pack > 1 && bsize > 256)                        //  deflate if it helps
+      if (zlib_convert(0,&body[0],bsize,zbody,bsize-1) == 0) encoding = puz_deflate;
+
+   if (encoding == puz_flat) size = hsize + bsize + 8;
+   else if (encoding == puz_sparse) size = hsize + body.size() + 8;
+   else size = hsize + zbody.size() + 8;
+
+   buff.assign(size,0);
+
+   memset(&head,0,sizeof(head));
+   memcpy(head.magic,puz_magic,8);
+   head.version = le32(encoding == puz_flat ? 1 : 2);                            //  flat: readable by version 1
+   head.hsize = le32(hsize);
+   head.Nrows = le32(Nrows);
+   head.Ncols = le32(Ncols);
+   head.tileU = le32(tileU);
+   head.tileW = le32(tileW);
+   head.tileH = le32(tileH);
+   head.Nhome = le32(Nhome);
+   head.imagehash = le64(ihash);
+   head.Lpath = le32(Lpath);
+   head.encoding = le32(encoding);
+   head.bsize = le32(bsize);
+
+   memcpy(&buff[0],&head,sizeof(head));
+   memcpy(&buff[sizeof(head)],imagefile.c_str(),Lpath);
+
+   if (encoding == puz_flat) {
+      uint32 *posn = (uint32 *) &buff[hsize];                                    //  flat permutation
+      for (int ii = 0; ii < Ntiles; ii++)
+         posn[ii] = le32(pstate.wposn(ii));
    }
+   else if (encoding == puz_sparse) memcpy(&buff[hsize],&body[0],body.size());
+   else memcpy(&buff[hsize],&zbody[0],zbody.size());
 
-mdone:
-   stbar_update();                                                               //  update status bar
+   uint64 csum = le64(zhash64(&buff[0],size-8));                                 //  trailing checksum
+   memcpy(&buff[size-8],&csum,8);
    return;
 }
 
 
-//  chage tile borderline color                                                  //  gtk3
+//  positions of misplaced tiles as varint deltas, see puz_sparse
+//  O(M log M) for M misplaced tiles, about 3-4 bytes per tile
+//  if tiles are near their home positions
 
-void m_line()
+void puzzle_sparse(vector<uint8> &body)
 {
-   linecolor++;
-   if (linecolor > 3) linecolor = 0;
-   gtk_widget_queue_draw(dwin1);
+   vector<int>    tiles(Mtiles);
+   int            prior = -1;
+
+   std::sort(tiles.begin(),tiles.end());
+   body.clear();
+   body.reserve(5 + 6 * tiles.size());
+   varint_put(body,tiles.size());
+
+   for (int tile : tiles) {
+      int64 dd = (int64) pstate.wposn(tile) - tile;                              //  zigzag: small + or - is small
+      varint_put(body,tile - prior - 1);
+      varint_put(body,((uint64) dd << 1) ^ (uint64) (dd >> 63));
+      prior = tile;
+   }
    return;
 }
 
 
-//  quit function with last chance to save unfinished puzzle
+//  deflate (raw, no header) or inflate data[cc] with GLib into out,
+//  which must fit in outcc bytes. returns 0 = OK, 1 = does not fit
+//  or data not valid
 
-void m_quit()
+int zlib_convert(int inflate, const uint8 *data, size_t cc, vector<uint8> &out, size_t outcc)
 {
-   if (puzzle_status()) return;                                                  //  do not discard
-   save_imagedirk();                                                             //  for next session  v.1.8
-   gtk_main_quit();
-   return;
+   GConverter        *conv;
+   GConverterResult  result;
+   GError            *gerror = 0;
+   gsize             Nread = 0, Nwritten = 0;
+
+   if (! outcc) return 1;
+   if (inflate) conv = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW));
+   else conv = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW,6));
+
+   out.resize(outcc);
+   result = g_converter_convert(conv,data,cc,&out[0],outcc,G_CONVERTER_INPUT_AT_END,
+                                                         &Nread,&Nwritten,&gerror);
+   g_object_unref(conv);
+   if (gerror) g_error_free(gerror);
+   if (result != G_CONVERTER_FINISHED) return 1;                                 //  not all output fits, or error
+   out.resize(Nwritten);
+   return 0;
 }
 
 
-//  signal function for window destroy signal
+//  read a saved puzzle file into pstate, Nrows, Ncols, Ntiles, Nhome
+//  binary format: file is mapped into memory, checked, and the tile
+//  positions are copied from the mapped pages into pstate
+//  older text format: parsed by puzzle_read_text() from the mapped file
+//  image = image file name, ihash = image hash or 0 if unknown
+//  Nfix = tiles with a duplicate position, moved to unused positions
+//    (file rejected if more than 1/4 of the tiles)
+//  returns 0 = OK, 1 = cannot open, 2 = not valid, reason in puz_error
 
-void destroyfunc()
+int puzzle_read(cchar *file, string &image, uint64 &ihash, int &Nfix)
 {
-   if (puzzle_status()) m_save();                                                //  do not discard
-   gtk_main_quit();
-   return;
-}
-
+   int puzzle_read2(cchar *file, string &image, uint64 &ihash);
 
-//  test puzzle before discarding, give user a chance to save
-//  returns  0 = completed, unchanged, or user says discard
-//           1 = incomplete, modified, and user says keep
+   Nfix = 0;
+   puz_error.clear();
+   int stat = puzzle_read2(file,image,ihash);
+   if (stat) return stat;
 
-int puzzle_status()
-{
-   if (! Ntiles) return 0;                                                       //  no puzzle
-   if (! Nmoves) return 0;                                                       //  no new moves
-   if (Nhome == Ntiles) return 0;                                                //  puzzle done
-   if (zmessageYN(win1,ZTX("DISCARD unfinished puzzle?")))                       //  OK to discard
-      return 0;
-   return 1;                                                                     //  keep
+   Nfix = pstate.repair();                                                       //  positions are a permutation
+   if (Nfix > Ntiles / 4) return puzzle_invalid("%d of %d tiles have the same position",Nfix,Ntiles);
+   return 0;
 }
 
 
-//  thread function to display help file
+//  read either file format
 
-void m_help()                                                                    //  menu function
+int puzzle_read2(cchar *file, string &image, uint64 &ihash)
 {
-   showz_userguide();                                                            //  display help in new process
-   return;
-}
-
+   struct stat    sb;
+   int            fd, stat;
 
-//  initialize puzzle from image file with optional preservation
-//  of existing tile data (row and column counts, tile positions)
-//  called by new_puzzle() and resume_puzzle()
+   ihash = 0;
 
-void init_puzzle(int newp)
-{
-   if (imagefile.length() == 0) return;
+   fd = open(file,O_RDONLY);
+   if (fd < 0) return 1;
 
-   const char* pp = strrchr(imagefile.c_str(),'/');                                         //  puzzle name = image file name
-   if (! pp++) pp = imagefile.c_str();
-   pname = pp;
+   if (fstat(fd,&sb)) {
+      close(fd);
+      return 1;
+   }
 
-   if (iPixbuf) g_object_unref(iPixbuf);
-   GError      *gerror = nullptr;
-   iPixbuf = gdk_pixbuf_new_from_file(imagefile.c_str(),&gerror);                        //  create pixbuf from image file
-   if (!iPixbuf) {
-      zmessageACK(win1,ZTX("image type not recognized:\n %s"),imagefile.c_str());
-      clear_puzzle();
-      return;
+   size_t size = sb.st_size;
+   if (! size) {
+      close(fd);
+      return puzzle_invalid("file is empty");
    }
 
-   imageW = gdk_pixbuf_get_width(iPixbuf);                                       //  get image size
-   imageH = gdk_pixbuf_get_height(iPixbuf);
+   void *data = mmap(0,size,PROT_READ,MAP_PRIVATE,fd,0);                         //  both formats mapped
+   close(fd);
+   if (data == MAP_FAILED) return 1;
+   madvise(data,size,MADV_SEQUENTIAL);
 
-   if (imageW < 300 || imageH < 300) {
-      zmessageACK(win1,ZTX("image too small, please select another"));
-      clear_puzzle();
-      return;
+   if (size >= 8 && memcmp(data,puz_magic,8) == 0) {
+      stat = puzzle_read_binary((const uint8 *) data,size,image,ihash);
+      if (stat && puz_error.empty()) puzzle_invalid("binary file is damaged");
    }
+   else stat = puzzle_read_text((const uint8 *) data,size,image);               //  not binary, text format
 
-   tile_window(newp);                                                            //  paint tiles on main window
-
-   return;
+   munmap(data,size);
+   return stat;
 }
 
 
-//  release memory and clear all puzzle data
+//  check and load binary puzzle data[size]
 
-void clear_puzzle()
+int puzzle_read_binary(const uint8 *data, size_t size, string &image, uint64 &ihash)
 {
-   if (iPixbuf) g_object_unref(iPixbuf);
-   iPixbuf = 0;
-   Ntiles = Nmoves = Nhome = 0;
-   stbar_update();
-   return;
-}
-
+   puz_header_t   head;
+   uint64         csum;
+   vector<uint8>  zbody;
+
+   if (size < sizeof(head) + 8) return 2;
+   memcpy(&head,data,sizeof(head));
+   int version = le32(head.version);
+   if (version < 1 || version > puz_version)                                     //  unknown (newer) version
+      return puzzle_invalid("file version %d is not supported",version);
+
+   size_t hsize = le32(head.hsize);
+   size_t Lpath = le32(head.Lpath);
+   size_t bsize = le32(head.bsize);
+   int encoding = (version == 1) ? puz_flat : le32(head.encoding);
+   int64 Nr = le32(head.Nrows), Nc = le32(head.Ncols);
+
+   if (Nr < 1 || Nc < 1 || Nr > puz_maxtiles || Nc > puz_maxtiles) return 2;
+   if (Nr * Nc > puz_maxtiles) return 2;
+   if (hsize % 8 || hsize < sizeof(head) + Lpath) return 2;
+   if (encoding == puz_flat && size != hsize + 4 * Nr * Nc + 8) return 2;
+   if (encoding == puz_sparse && size != hsize + bsize + 8) return 2;
+   if (encoding == puz_deflate && (size <= hsize + 8 || (int64) bsize > 10 * Nr * Nc + 10)) return 2;
+   if (encoding < puz_flat || encoding > puz_deflate) return 2;
+
+   memcpy(&csum,data+size-8,8);                                                  //  whole file intact
+   if (le64(csum) != zhash64(data,size-8))
+      return puzzle_invalid("checksum error, file is damaged");
+
+   Nrows = Nr;
+   Ncols = Nc;
+   Ntiles = Nrows * Ncols;
+
+   if (encoding == puz_flat) {
+      uint32 pmax = pstate.load((const uint32 *) (data + hsize),Ntiles);         //  tile positions
+      if (pmax >= (uint32) Ntiles) return 2;
+   }
+   else
+   {
+      const uint8 *pp = data + hsize, *pend = data + size - 8;
+      if (encoding == puz_deflate) {
+         if (zlib_convert(1,pp,pend-pp,zbody,bsize) || zbody.size() != bsize) return 2;
+         pp = &zbody[0];
+         pend = pp + bsize;
+      }
 
-//  create tile pixmaps and paint tiles on window
-//  called by init_puzzle(), retile_puzzle(), winpaint()
+      uint64 NN, dtile, zz;                                                      //  misplaced tiles
+      int64 tile = -1, posn;
+      pstate.init(Ntiles);
+      if (! varint_get(pp,pend,NN) || NN > (uint64) Ntiles) return 2;
+      while (NN--) {
+         if (! varint_get(pp,pend,dtile) || ! varint_get(pp,pend,zz)) return 2;
+         if (dtile >= (uint64) Ntiles || zz > 2 * (uint64) Ntiles) return 2;
+         tile += dtile + 1;
+         posn = tile + ((int64) (zz >> 1) ^ -(int64) (zz & 1));
+         if (tile >= Ntiles || posn < 0 || posn >= Ntiles) return 2;
+         pstate.set_wposn(tile,posn);
+      }
+      if (pp != pend) return 2;
+   }
 
-void tile_window(int newp)
-{
-   if (! iPixbuf) return;
+   Nhome = le32(head.Nhome);
+   int tileU1 = le32(head.tileU);                                                //  user tile size for next puzzle,
+   if (tileU1 >= 20 && tileU1 <= 200) tileU = tileU1;                            //    if in m_tile() range
+   image.assign((cchar *) data + sizeof(head),Lpath);
+   ihash = le64(head.imagehash);
+   return 0;
+}
 
-   winW = gtk_widget_get_allocated_width(dwin1);                                 //  window size
-   winH = gtk_widget_get_allocated_height(dwin1);
 
-   winW = winW - 4;                                                              //  to keep margins visible
-   winH = winH - 4;
+//  read older text format puzzle file, data[size] mapped into memory:
+//    image file name / Ntiles Nhome / Nrows Ncols / row,col for each tile
+//  Hand-written scanner, 5-8x faster than fscanf() (see bench_text())
+//  and no allocation per tile. Errors give the line and column in puz_error.
+//  returns 0 = OK, 2 = not valid
 
-   int x1 = int(1.0 * winH * imageW / imageH);                                       //  preserve image X/Y ratio
-   if (winW > x1) winW = x1;
-   int y1 = int(1.0 * winW * imageH / imageW);
-   if (winH > y1) winH = y1;
+namespace text_scan_names
+{
+   cchar       *pp, *pend;                                                       //  next char, end of data
+   cchar       *line;                                                            //  start of current line
+   int         lineno;                                                           //  current line, 1-based
 
-   if (newp)                                                                     //  new puzzle
+   inline void space()                                                           //  skip white space
    {
-      Ncols = int(1.0 * winW / tileU + 0.5);                                     //  best fit to user tile size
-      Nrows = int(1.0 * winH / tileU + 0.5);
-      Ntiles = Nrows * Ncols;
-      Nhome = Ntiles;
+      while (pp < pend && (*pp == ' ' || (*pp >= '\t' && *pp <= '\r'))) {
+         if (*pp == '\n') {
+            lineno++;
+            line = pp + 1;
+         }
+         pp++;
+      }
+   }
 
-	  wposn.clear();
-	  wposn.resize(Ntiles);
+   inline int number(int &val)                                                   //  [+-]digits, as %d
+   {                                                                             //  returns 0 if none or too big
+      int      neg = 0;
+      int64    vv = 0;
+      cchar    *pp0 = pp;
 
-      for (int row = 0; row < Nrows; row++) {
-		for (int col = 0; col < Ncols; col++)
-		{
-		   int ii = Tindex(row,col);                                                   //  all window positions = home
-		   wposn[ii].row = row;
-		   wposn[ii].col = col;
-		}
-	  }
+      if (pp < pend && (*pp == '-' || *pp == '+')) neg = (*pp++ == '-');
+      if (pp == pend || *pp < '0' || *pp > '9') {
+         pp = pp0;
+         return 0;
+      }
+      while (pp < pend && *pp >= '0' && *pp <= '9') {
+         vv = vv * 10 + (*pp++ - '0');
+         if (vv > 0x7fffffff) {
+            pp = pp0;
+            return 0;
+         }
+      }
+      val = neg ? -vv : vv;
+      return 1;
    }
 
-   hposn.clear();
-   hposn.resize(Ntiles);
-
-   for (int row = 0; row < Nrows; row++)                                             //  initialize home position map
-   for (int col = 0; col < Ncols; col++)                                             //    from window position map
+   int error(cchar *expected)                                                    //  "line L column C: ..."
    {
-      int ii = Tindex(row,col);
-      ii = Tindex(wposn[ii].row,wposn[ii].col);
-      hposn[ii].row = row;
-      hposn[ii].col = col;
+      char     found[20];
+
+      if (pp == pend) strcpy(found,"end of file");
+      else if ((*pp >= '0' && *pp <= '9') || ((*pp == '-' || *pp == '+')
+                  && pp + 1 < pend && pp[1] >= '0' && pp[1] <= '9'))
+         strcpy(found,"number too large");
+      else if (*pp > ' ' && *pp < 0x7f) snprintf(found,20,"'%c'",*pp);
+      else snprintf(found,20,"byte 0x%02x",(uint8) *pp);
+      return puzzle_invalid("line %d column %d: %s expected, %s found",
+                                    lineno,int(pp - line + 1),expected,found);
    }
+}
 
-   tileW = winW / Ncols;                                                         //  actual tile size to use
-   tileH = winH / Nrows;
-
-   winW = Ncols * tileW;                                                         //  synch. window to tile size
-   winH = Nrows * tileH;
 
-   if (wPixbuf) g_object_unref(wPixbuf);                                         //  gtk3
-   wPixbuf = gdk_pixbuf_scale_simple(iPixbuf,winW,winH,interp);                  //  scale image to window size
+int puzzle_read_text(const uint8 *data, size_t size, string &image)
+{
+   using namespace text_scan_names;
 
-   if (mwcr) {
-      for (int row = 0; row < Nrows; row++) {                                          //  draw tile pixmaps on window
-		for (int col = 0; col < Ncols; col++) {
-		   draw_tile(row,col);
-		}
-	  }
+   int         row2, col2;
+   cchar       *pp1;
+
+   pp = line = (cchar *) data;
+   pend = pp + size;
+   lineno = 1;
+
+   while (pp < pend && *pp != '\n') pp++;                                        //  image file name,
+   for (pp1 = pp; pp1 > line && (pp1[-1] == ' ' || pp1[-1] == '\t' || pp1[-1] == '\r'); pp1--);
+   if (pp1 - line >= XFCC) return puzzle_invalid("line 1: image file name too long");
+   image.assign(line,pp1 - line);                                                //    less trailing blanks
+
+   space();
+   if (! number(Ntiles)) return error("tile count");
+   space();
+   if (! number(Nhome)) return error("tiles home count");
+   space();
+   pp1 = pp;
+   if (! number(Nrows)) return error("row count");                               //  row and col counts
+   if (Nrows < 1) {
+      pp = pp1;
+      return puzzle_invalid("line %d column %d: row count %d is not > 0",
+                                    lineno,int(pp - line + 1),Nrows);
    }
-   else {
-      mwcr = gdk_cairo_create(gtk_widget_get_window(dwin1));                     //  gtk3
-      cairo_set_line_width(mwcr,1);
-      for (int row = 0; row < Nrows; row++) {
-		for (int col = 0; col < Ncols; col++) {
-		   draw_tile(row,col);
-		}
-	  }
-      cairo_destroy(mwcr);
-      mwcr = 0;
+   space();
+   pp1 = pp;
+   if (! number(Ncols)) return error("column count");
+   if (Ncols < 1) {
+      pp = pp1;
+      return puzzle_invalid("line %d column %d: column count %d is not > 0",
+                                    lineno,int(pp - line + 1),Ncols);
    }
 
-   Mstate = 0;                                                                   //  no tile selected
-   stbar_update();                                                               //  update status bar
-   return;
-}
-
-
-//  process mouse events (button down, button up)
+   if ((int64) Nrows * Ncols != Ntiles)                                          //  no overflow
+      return puzzle_invalid("line %d: %d rows x %d columns is not %d tiles",lineno,Nrows,Ncols,Ntiles);
+   if (Ntiles > (int64) size / 4)                                                //  " r,c" per tile, no huge alloc.
+      return puzzle_invalid("%d tiles, file is too short (%lld bytes)",Ntiles,(int64) size);
+
+   pstate.init(Ntiles);
+
+   for (int row1 = 0; row1 < Nrows; row1++) {                                    //  read tile position data
+      for (int col1 = 0; col1 < Ncols; col1++) {
+         space();
+         pp1 = pp;
+         if (! number(row2)) return error("tile row");
+         if (row2 < 0 || row2 >= Nrows) {
+            pp = pp1;
+            return puzzle_invalid("line %d column %d: tile row %d is not 0 to %d",
+                                          lineno,int(pp - line + 1),row2,Nrows-1);
+         }
+         if (pp == pend || *pp != ',') return error("','");
+         pp++;
+         space();
+         pp1 = pp;
+         if (! number(col2)) return error("tile column");
+         if (col2 < 0 || col2 >= Ncols) {
+            pp = pp1;
+            return puzzle_invalid("line %d column %d: tile column %d is not 0 to %d",
+                                          lineno,int(pp - line + 1),col2,Ncols-1);
+         }
+         pstate.set_wposn(Tindex(row1,col1),Tindex(row2,col2));
+      }
+   }
 
-void mouse_event(GtkWidget *, GdkEventButton *event)
+   return 0;                                                                     //  trailing data ignored, as before
+}
+
+
+//  set puz_error, for puzzle_read() callers. returns 2 = not valid.
+
+int puzzle_invalid(cchar *format, ...)
 {
-   static int  row1, col1, row2, col2;
+   va_list     arglist;
+   char        message[200];
 
-   if (! Ntiles) return;
+   va_start(arglist,format);
+   vsnprintf(message,200,format,arglist);
+   va_end(arglist);
 
-   int button = event->button;                                                       //  1/2/3 = left/middle/right
-   int x = int(event->x);
-   int y = int(event->y);
+   puz_error = message;
+   return 2;
+}
 
-   if (x < 1 || x >= (Ncols * tileW)) goto mret0;                                //  ignore if not within picture
-   if (y < 1 || y >= (Nrows * tileH)) goto mret0;
 
-   if (button == 3) {                                                            //  if right button,
-      row1 = y / tileH;                                                          //    get tile belonging here
-      col1 = x / tileW;
-      int ii = Tindex(row1,col1);
-      row2 = wposn[ii].row;                                                      //  where it is now
-      col2 = wposn[ii].col;
-      swap_tiles(row1,col1,row2,col2);                                           //  swap
-      goto mret0;
-   }
+//  content hash of an image file, to detect an edited or replaced
+//  image when a saved puzzle is resumed. returns 0 if not readable.
+//  The last hash is kept for the same file, inode, size and mtime,
+//  so saving again does not read the whole image. UI thread only.
 
-   if (Mstate < 2) {                                                             //  1st tile selection
-      row1 = y / tileH;
-      col1 = x / tileW;
-   }
+uint64 image_hash(cchar *file)
+{
+   static string        file1;                                                   //  last file hashed
+   static struct stat   sb1;
+   static uint64        hash1 = 0;
+   struct stat          sb;
+   uint64               hash = 0;
 
-   else {                                                                        //  2nd tile selection
-      row2 = y / tileH;
-      col2 = x / tileW;
+   int fd = open(file,O_RDONLY);
+   if (fd < 0) return 0;
+
+   if (fstat(fd,&sb) == 0 && sb.st_size > 0)
+   {
+      if (hash1 && file1 == file && sb.st_dev == sb1.st_dev && sb.st_ino == sb1.st_ino
+                && sb.st_size == sb1.st_size && sb.st_mtim.tv_sec == sb1.st_mtim.tv_sec
+                && sb.st_mtim.tv_nsec == sb1.st_mtim.tv_nsec) {
+         close(fd);                                                              //  unchanged, use last hash
+         return hash1;
+      }
+
+      void *data = mmap(0,sb.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+      if (data != MAP_FAILED) {
+         hash = zhash64(data,sb.st_size);
+         munmap(data,sb.st_size);
+         file1 = file;
+         sb1 = sb;
+         hash1 = hash;
+      }
    }
 
-   Mstate++;
+   close(fd);
+   return hash;
+}
 
-   if (Mstate < 4) goto mret;
-   swap_tiles(row1,col1,row2,col2);                                              //  last button up
 
-mret0:
-   Mstate = 0;
+//  Autosave for crash or power loss. Moves are not written by the UI
+//  thread: swap2() and move_tiles() append the swapped window positions
+//  to ASswaps, and a timer hands them in batches to a writer thread,
+//  which appends one record to the journal file and calls fdatasync().
+//  A new puzzle, a mix, or a journal longer than max(Ntiles,64k) swaps
+//  makes the next batch a checkpoint instead: the whole puzzle in the
+//  binary file format, written to a temp file and renamed, then a new
+//  empty journal. Replay at startup is the checkpoint plus at most that
+//  many swaps, so it takes about as long as loading the checkpoint.
+//
+//  journal file: magic, uint64 checkpoint checksum, records of
+//    uint32 N, uint32 window positions [2*N], uint64 zhash64() of record
+//  A torn last record (crash while writing) fails its checksum and is
+//  ignored. A journal of an older checkpoint is ignored.
+
+void autosave_start()
+{
+   int autosave_timer(void *);
 
-mret:
-   stbar_update();                                                               //  update status bar
+   ASfile = string(get_zuserdir()) + "/autosave.puz";
+   ASjfile = string(get_zuserdir()) + "/autosave.log";
+   AStimer = g_timeout_add(2000,autosave_timer,0);                               //  batch every 2 secs
    return;
 }
 
 
-//  swap two tile positions on window
+//  clean exit: wait for writer, remove files
 
-void swap_tiles(int row1, int col1, int row2, int col2)
+void autosave_stop()
 {
-   void swap2(int, int, int, int);                                               //  private functions
-   void swap3(int, int, int, int);
-
-   swap2(row1,col1,row2,col2);                                                   //  swap the two tiles
-   swap3(row1,col1,row2,col2);                                                   //  move adjacent tiles home
-   swap3(row2,col2,row1,col1);                                                   //  move adjacent tiles home
+   if (AStimer) g_source_remove(AStimer);
+   AStimer = 0;
+   while (ASbusy) zsleep(0.01);
+   if (ASjfd >= 0) close(ASjfd);
+   ASjfd = -1;
+   if (ASfile.length()) remove(ASfile.c_str());
+   if (ASjfile.length()) remove(ASjfile.c_str());
    return;
 }
 
 
-//  perform the swap of the two tiles only
+//  record a swap of two window positions
 
-void swap2(int row1, int col1, int row2, int col2)
+void autosave_swap(int ii1, int ii2)
 {
-   if (! Ntiles) return;
-   if (row1 == row2 && col1 == col2) return;
+   if (ASfull) return;                                                           //  checkpoint pending
+   ASswaps.push_back(ii1);
+   ASswaps.push_back(ii2);
+   return;
+}
 
-   int ii1 = Tindex(row1,col1);                                                      //  count tiles moved from home
-   int ii2 = Tindex(row2,col2);
-   if (hposn[ii1].row == row1 && hposn[ii1].col == col1) Nhome--;
-   if (hposn[ii2].row == row2 && hposn[ii2].col == col2) Nhome--;
 
-   ii1 = Tindex(row1,col1);                                                      //  swap home positions for window tiles
-   ii2 = Tindex(row2,col2);                                                      //    at (row1,col1) and (row2,col2)
-   std::swap(hposn[ii1].row,hposn[ii2].row);
-   std::swap(hposn[ii1].col,hposn[ii2].col);
+//  puzzle replaced or rearranged: next batch is a checkpoint
 
-   ii1 = Tindex(hposn[ii1].row,hposn[ii1].col);                                  //  swap window positions for home tiles
-   ii2 = Tindex(hposn[ii2].row,hposn[ii2].col);                                  //    of these window positions
-   std::swap(wposn[ii1].row,wposn[ii2].row);
-   std::swap(wposn[ii1].col,wposn[ii2].col);
+void autosave_checkpoint()
+{
+   ASfull = 1;
+   ASswaps.clear();
+   return;
+}
 
-   mwcr = gdk_cairo_create(gtk_widget_get_window(dwin1));                        //  gtk3
-   cairo_set_line_width(mwcr,1);
-   draw_tile(row1,col1);                                                         //  draw tiles at new positions
-   draw_tile(row2,col2);
-   cairo_destroy(mwcr);
-   mwcr = 0;
 
-   Nmoves++;                                                                     //  incr. move count
+//  timer function: hand pending moves or a checkpoint to the writer
 
-   ii1 = Tindex(row1,col1);                                                      //  count tiles moved to home
-   ii2 = Tindex(row2,col2);
-   if (hposn[ii1].row == row1 && hposn[ii1].col == col1) Nhome++;
-   if (hposn[ii2].row == row2 && hposn[ii2].col == col2) Nhome++;
+int autosave_timer(void *)
+{
+   void * autosave_thread(void *);
+
+   if (ASbusy) return 1;                                                         //  writer busy, try next time
+   if (ASjfd < 0) ASfull = 1;                                                    //  no journal or write error
+   if (ASjsize + (int64) ASswaps.size() / 2 > (Ntiles > 65536 ? Ntiles : 65536))
+      ASfull = 1;                                                                //  bound replay time
+
+   ASjob.ckpt.clear();
+   ASjob.swaps.clear();
+   ASjob.remove = 0;
+
+   if (! Ntiles) {                                                               //  no puzzle
+      if (! ASsaved) return 1;
+      ASjob.remove = 1;
+      ASsaved = 0;
+      ASfull = 1;
+   }
+   else if (ASfull) {
+      puzzle_encode(ASjob.ckpt,0,1);                                             //  snapshot, O(misplaced tiles)
+      ASswaps.clear();
+      ASjsize = 0;
+      ASfull = 0;
+      ASsaved = 1;
+   }
+   else if (ASswaps.size()) {
+      std::swap(ASjob.swaps,ASswaps);
+      ASjsize += ASjob.swaps.size() / 2;
+   }
+   else return 1;                                                                //  nothing new
 
-   return;
+   ASbusy = 1;
+   start_detached_thread(autosave_thread,0);
+   return 1;
 }
 
 
-//  When a tile is moved to its home position, find all adjoining tiles
-//  that will also be home if moved in parallel with the first tile.
-//  (move home a cluster of fitting tiles all of which are "off by N")
+//  writer thread: write ASjob to disk, then release it
 
-void swap3(int row1, int col1, int row2, int col2)
+void * autosave_thread(void *)
 {
-   int      iiy, jj, kk, drow, dcol, change;
-   int      adjrow[4] = { -1, 0, 0, +1 };
-   int      adjcol[4] = { 0, -1, +1, 0 };
-   int      rowy, coly, rowz, colz;
+   autosave_job_t    &job = ASjob;
+   int               err = 0;
+
+   if (job.remove) {
+      if (ASjfd >= 0) close(ASjfd);
+      ASjfd = -1;
+      remove(ASfile.c_str());
+      remove(ASjfile.c_str());
+   }
 
-   int ii1 = Tindex(row1,col1);
-   if (hposn[ii1].row != row1 || hposn[ii1].col != col1)                         //  if tile1 not at home,
-      return;                                                                    //    nothing to do
+   if (job.ckpt.size())                                                          //  new checkpoint
+   {
+      if (ASjfd >= 0) close(ASjfd);                                              //  old journal is obsolete
+      ASjfd = -1;
+
+      if (zwrite_atomic(ASfile.c_str(),&job.ckpt[0],job.ckpt.size())) err = 1;
+      if (! err) {
+         memcpy(&AScsum,&job.ckpt[job.ckpt.size()-8],8);
+         uint8 head[16];                                                         //  new journal for checkpoint
+         memcpy(head,ASjmagic,8);
+         memcpy(head+8,&AScsum,8);
+         ASjfd = open(ASjfile.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+         if (ASjfd >= 0 && write(ASjfd,head,16) != 16) err = 1;
+      }
+   }
 
-   drow = row2 - row1;
-   dcol = col2 - col1;
+   if (job.swaps.size() && ASjfd >= 0)                                           //  one journal record
+   {
+      uint32 NN = le32(job.swaps.size() / 2);
+      job.swaps.insert(job.swaps.begin(),NN);
+      for (size_t ii = 1; ii < job.swaps.size(); ii++) job.swaps[ii] = le32(job.swaps[ii]);
+      size_t cc = 4 * job.swaps.size();
+      uint64 csum = le64(zhash64(&job.swaps[0],cc,le64(AScsum)));
+      job.swaps.resize(job.swaps.size() + 2);
+      memcpy(&job.swaps[job.swaps.size()-2],&csum,8);
+      if (write(ASjfd,&job.swaps[0],cc+8) != (ssize_t) (cc+8)) err = 1;
+   }
 
-   vector<int> Rstack(Ntiles);
-   vector<int> Cstack(Ntiles);
+   if (ASjfd >= 0 && ! err && fdatasync(ASjfd)) err = 1;
+   if (err && ASjfd >= 0) {                                                      //  next batch is a new checkpoint
+      close(ASjfd);
+      ASjfd = -1;
+   }
 
-   Rstack[0] = row1;
-   Cstack[0] = col1;
-   int Nstack = 1;
-   int Estack = 0;
+   __sync_synchronize();                                                         //  job done before not busy
+   ASbusy = 0;
+   return 0;
+}
 
-   while (Estack < Nstack)
-   {
-      row1 = Rstack[Estack];
-      col1 = Cstack[Estack];
-      Estack++;
 
-      for (jj = 0; jj < 4; jj++)
-      {
-         int rowx = row1 + adjrow[jj];                                               //  tilex is adjoining a tile
-         int colx = col1 + adjcol[jj];                                               //    that was moved to home
-         if (rowx < 0 || colx < 0) continue;                                     //  skip if out of bounds
-         if (rowx == Nrows || colx == Ncols) continue;
+//  restore the autosaved puzzle after a crash: checkpoint, then the
+//  swaps of all valid journal records. returns 1 if restored.
+//  A checkpoint that is not valid, or whose image cannot be read, is
+//  discarded with its journal.
 
-         rowy = rowx + drow;                                                     //  corresponding tiley where
-         coly = colx + dcol;                                                     //    home tile was moved from
-         if (rowy < 0 || coly < 0) continue;                                     //  skip if out of bounds
-         if (rowy == Nrows || coly == Ncols) continue;
+int autosave_restore()
+{
+   string         image;
+   uint64         ihash, csum = 0;
+   struct stat    sb;
+   int64          Nswaps = 0;
+   int            Nfix;
+
+   int stat = puzzle_read(ASfile.c_str(),image,ihash,Nfix);
+   if (stat == 1) return 0;                                                      //  no checkpoint
+   if (stat) {                                                                   //  not valid, discard
+      clear_puzzle();
+      remove(ASfile.c_str());
+      remove(ASjfile.c_str());
+      return 0;
+   }
 
-         iiy = Tindex(rowy,coly);
-         rowz = hposn[iiy].row;                                                  //  get home position of tiley
-         colz = hposn[iiy].col;
-         if (rowz == rowx && colz == colx) {                                     //  tiley home = tilex position?
-            for (kk = 0; kk < Nstack; kk++)                                      //  yes, check if tilex in stack
-               if (rowx == Rstack[kk] && colx == Cstack[kk]) break;
-            if (kk == Nstack) {                                                  //  no
-               Rstack[kk] = rowx;                                                //  add tilex to stack
-               Cstack[kk] = colx;
-               Nstack++;
-            }
-         }
-      }
+   int fd = open(ASfile.c_str(),O_RDONLY);                                       //  checkpoint checksum
+   if (fd >= 0) {
+      if (fstat(fd,&sb) || pread(fd,&csum,8,sb.st_size-8) != 8) csum = 0;
+      close(fd);
    }
 
-   change = 1;
-   while (change)
+   pstate.set_hposn();
+   fd = open(ASjfile.c_str(),O_RDONLY);
+   if (fd >= 0 && csum && fstat(fd,&sb) == 0 && sb.st_size >= 16)
    {
-      change = 0;
-      Estack = 0;
-      while (Estack < Nstack)
+      size_t size = sb.st_size;
+      void *data = mmap(0,size,PROT_READ,MAP_PRIVATE,fd,0);
+      const uint8 *pp = (const uint8 *) data;
+
+      if (data != MAP_FAILED && memcmp(pp,ASjmagic,8) == 0 && memcmp(pp+8,&csum,8) == 0)
       {
-         int rowx = Rstack[Estack];                                                  //  next tile position from stack,
-         int colx = Cstack[Estack];                                                  //    to be filled with home tile
-         Estack++;
-         int iix = Tindex(rowx,colx);
-         rowz = hposn[iix].row;                                                  //  home position of tile
-         colz = hposn[iix].col;
-         if (rowz != rowx || colz != colx) {                                     //  if not already home
-            rowz = wposn[iix].row;                                               //  get position of home tile
-            colz = wposn[iix].col;
-            swap2(rowx,colx,rowz,colz);                                          //  swap
-            change++;
+         size_t off = 16;
+         int bad = 0;
+         while (! bad && off + 12 <= size)                                       //  records
+         {
+            uint64 NN = le32(*(const uint32 *) (pp + off));
+            size_t cc = 4 + 8 * NN;
+            if (off + cc + 8 > size) break;                                      //  torn record
+            uint64 rsum;
+            memcpy(&rsum,pp+off+cc,8);
+            if (le64(rsum) != zhash64(pp+off,cc,le64(csum))) break;
+            const uint32 *posn = (const uint32 *) (pp + off + 4);
+            for (uint64 ii = 0; ii < 2 * NN && ! bad; ii += 2) {
+               uint32 ii1 = le32(posn[ii]), ii2 = le32(posn[ii+1]);
+               if (ii1 >= (uint32) Ntiles || ii2 >= (uint32) Ntiles) bad = 1;
+               else pstate.swap(ii1,ii2);
+            }
+            Nswaps += NN;
+            off += cc + 8;
          }
       }
+
+      if (data != MAP_FAILED) munmap(data,size);
+   }
+   if (fd >= 0) close(fd);
+
+   imagefile = image;
+   free_refimage();
+   init_puzzle(0);                                                               //  new checkpoint follows
+   if (! Ntiles) {                                                               //  image gone or not readable,
+      remove(ASfile.c_str());                                                    //    discard
+      remove(ASjfile.c_str());
+      return 0;
    }
+   Nmoves = Nswaps + 1;                                                          //  ask before discard
+   stbar_update();
+   if (Nfix)                                                                     //  damaged checkpoint, repaired
+      zmessageACK(win1,ZTX("autosaved puzzle is damaged, %d tiles were moved"),Nfix);
+   return 1;
+}
+
+
+//  move tiles into place automatically
+
+void m_doN(int nn1)
+{
+   int doN_step(int kk);
+
+   if (! Ntiles) return;
+   anim_finish();
+   double secs = 0.02 * nn1;                                                     //  20 ms per tile,
+   if (secs > animtime) secs = animtime;                                         //    limited to -a secs
+   anim_begin(doN_step,nn1,secs);
    return;
 }
 
 
-//  draw tile at window position (row, col)
+//  animation step: move a random misplaced tile home
+//  returns 0 if all tiles are home
 
-void draw_tile(int row, int col)
+int doN_step(int)
 {
-   void  draw_body(int row, int col);
-   void  draw_lobe(int row, int col);
-   void  draw_hole(int row, int col);
+   if (Mtiles.empty()) return 0;
+   int ii = Mtiles[lrand(rseed,Mtiles.size())];                                  //  random misplaced tile
+   int row1 = ii / Ncols;                                                        //  home position
+   int col1 = ii - row1 * Ncols;
+   int posn = pstate.wposn(ii);                                                  //  where it is now
+   swap_tiles(row1,col1,posn/Ncols,posn%Ncols);                                  //  move tile home
+   return 1;
+}
 
-   if (col > 0) {
-      draw_body(row,col-1);                                                      //  refresh tile to left
-      draw_lobe(row,col-1);
-      draw_hole(row,col-1);
-   }
 
-   draw_body(row,col);                                                           //  refresh this tile
-   draw_lobe(row,col);
-   draw_hole(row,col);
+//  Tile animation for m_mix() and m_doN(). A step function changes the
+//  puzzle model (one tile swap) and queues repaint of the damaged tiles.
+//  A frame clock callback runs as many steps as needed to keep pace with
+//  the target duration, so all swaps of a frame are painted together and
+//  the duration does not depend on the tile count. Duration 0 runs all
+//  steps at once (automation, -a 0).
 
-   if (col < Ncols-1) draw_lobe(row,col+1);                                      //  refresh lobe from tile to right
+void anim_begin(int step(int), int Nsteps, double secs)
+{
+   int anim_tick_func(GtkWidget *, GdkFrameClock *, void *);
+
+   anim_finish();
+
+   anim_step = step;
+   anim_Nsteps = Nsteps;
+   anim_Ndone = 0;
+   anim_secs = secs;
+   anim_t0 = 0;
+
+   if (secs <= 0 || ! gtk_widget_get_mapped(dwin1)) {                            //  instant mode
+      anim_finish();
+      return;
+   }
+
+   anim_tick = gtk_widget_add_tick_callback(dwin1,anim_tick_func,0,0);
    return;
 }
 
-//  draw tile body at window position (no lobes or holes)
 
-void draw_body(int row2, int col2)
+//  frame clock callback: run steps due at this frame time
+
+int anim_tick_func(GtkWidget *, GdkFrameClock *clock, void *)
 {
-   int         ii, row1, col1;
-   int         x1, y1, x2, y2, rs;
-   uint8       *ptile;
-   PIXBUF      *tPixbuf;                                                         //  tile pixbuf
+   int64 now = gdk_frame_clock_get_frame_time(clock);
+   if (! anim_t0) anim_t0 = now;                                                 //  first frame
 
-   ii = Tindex(row2,col2);                                                       //  tile home position
-   row1 = hposn[ii].row;
-   col1 = hposn[ii].col;
+   double frac = (now - anim_t0) / (1e6 * anim_secs);
+   int Ndue = int(frac * anim_Nsteps) + 1;                                       //  >= 1 step per frame
+   if (Ndue > anim_Nsteps) Ndue = anim_Nsteps;
 
-   x1 = col1 * tileW;                                                            //  position in image
-   y1 = row1 * tileH;
-   x2 = col2 * tileW;                                                            //  position in window
-   y2 = row2 * tileH;
+   while (anim_Ndone < Ndue)
+      if (! anim_step(anim_Ndone++)) anim_Ndone = anim_Nsteps;                   //  nothing left to do
+
+   stbar_update();
+   if (anim_Ndone < anim_Nsteps) return G_SOURCE_CONTINUE;
+   anim_tick = 0;
+   return G_SOURCE_REMOVE;
+}
 
-   rs = gdk_pixbuf_get_rowstride(wPixbuf);
-   ptile = gdk_pixbuf_get_pixels(wPixbuf) + y1 * rs + 3 * x1;                    //  draw tile        gtk3
-   tPixbuf = gdk_pixbuf_new_from_data(ptile,GDKRGB,0,8,tileW,tileH,rs,0,0);
-   gdk_cairo_set_source_pixbuf(mwcr,tPixbuf,x2,y2);
-   cairo_paint(mwcr);
-   g_object_unref(tPixbuf);
 
-   if (linecolor == 0) cairo_set_source_rgb(mwcr,1,1,1);                         //  draw tile outline   gtk3
-   if (linecolor == 1) cairo_set_source_rgb(mwcr,0,0,0);
-   if (linecolor == 2) cairo_set_source_rgb(mwcr,1,0,0);
-   if (linecolor == 3) cairo_set_source_rgb(mwcr,0,1,0);
+//  do all remaining steps now
 
-   cairo_rectangle(mwcr,x2,y2,tileW,tileH);
-   cairo_stroke(mwcr);
+void anim_finish()
+{
+   if (anim_tick) gtk_widget_remove_tick_callback(dwin1,anim_tick);
+   anim_tick = 0;
+   if (anim_Ndone >= anim_Nsteps) return;
 
+   while (anim_Ndone < anim_Nsteps)
+      if (! anim_step(anim_Ndone++)) break;
+   anim_Ndone = anim_Nsteps;
+   stbar_update();
    return;
 }
 
-//  draw protruding lobe from left side of puzzle tile at window position
 
-void draw_lobe(int row2, int col2)
+//  cancel remaining steps (puzzle is gone)
+
+void anim_stop()
 {
-   int         ii, row1, col1, rs;
-   int         x1, y1, x2, y2, px, py, pw, ph;
-   int64       seed;
-   uint8       *plobe;
-   PIXBUF      *lPixbuf;                                                         //  lobe pixbuf
+   if (anim_tick) gtk_widget_remove_tick_callback(dwin1,anim_tick);
+   anim_tick = 0;
+   anim_Ndone = anim_Nsteps;
+   return;
+}
 
-   if (col2 == 0) return;                                                        //  window position on left edge
 
-   ii = Tindex(row2,col2);                                                       //  get home position for tile
-   row1 = hposn[ii].row;
-   col1 = hposn[ii].col;
-   if (col1 == 0) return;                                                        //  home position on left edge
+//  chage tile borderline color                                                  //  gtk3
 
-   seed = row1 + col1;
-   px = int(0.2 * tileW + 0.5);                                                  //  get lobe position, size
-   py = int(drand(seed,0.6) * tileH + 0.1 * tileH);
-   pw = int(0.2 * tileW + 0.5);
-   ph = int(0.2 * tileH + 0.5);
-   x1 = col1 * tileW - px;                                                       //  position in image
-   y1 = row1 * tileH + py;
-   x2 = col2 * tileW - px;                                                       //  position in window
-   y2 = row2 * tileH + py;
+void m_line()
+{
+   linecolor++;
+   if (linecolor > 3) linecolor = 0;
+   if (! Ntiles || ! wSurface) return;
+   build_atlas();                                                                //  new tile outlines
+   redraw_all();
+   return;
+}
 
-   rs = gdk_pixbuf_get_rowstride(wPixbuf);
-   plobe = gdk_pixbuf_get_pixels(wPixbuf) + y1 * rs + 3 * x1;                    //  draw lobe        gtk3
-   lPixbuf = gdk_pixbuf_new_from_data(plobe,GDKRGB,0,8,pw,ph,rs,0,0);
-   gdk_cairo_set_source_pixbuf(mwcr,lPixbuf,x2,y2);
-   cairo_paint(mwcr);
-   g_object_unref(lPixbuf);
 
-   if (linecolor == 0) cairo_set_source_rgb(mwcr,1,1,1);
-   if (linecolor == 1) cairo_set_source_rgb(mwcr,0,0,0);
-   if (linecolor == 2) cairo_set_source_rgb(mwcr,1,0,0);
-   if (linecolor == 3) cairo_set_source_rgb(mwcr,0,1,0);
+//  quit function with last chance to save unfinished puzzle
+
+void m_quit()
+{
+   if (puzzle_status()) return;                                                  //  do not discard
+   save_imagedirk();                                                             //  for next session  v.1.8
+   gtk_main_quit();
+   return;
+}
+
 
-   cairo_move_to(mwcr,x2+pw,y2);                                                 //  draw lobe outline    gtk3
-   cairo_line_to(mwcr,x2,y2);
-   cairo_line_to(mwcr,x2,y2+ph);
-   cairo_line_to(mwcr,x2+pw,y2+ph);
-   cairo_stroke(mwcr);
+//  signal function for window destroy signal
 
+void destroyfunc()
+{
+   if (puzzle_status()) m_save();                                                //  do not discard
+   gtk_main_quit();
    return;
 }
 
-//  draw recess hole on right side where lobe from right fits in
 
-void draw_hole(int row2, int col2)
+//  main window keyboard shortcuts: Ctrl+Z undo, Ctrl+Y or Ctrl+Shift+Z redo
+
+int KBpress(GtkWidget *, GdkEventKey *event)
 {
-   int      ii, row1, col1;
-   int      x2, y2, px, py, pw, ph;
-   int64    seed;
+   if (! (event->state & GDK_CONTROL_MASK)) return 0;                            //  not handled
 
-   ii = Tindex(row2,col2);                                                       //  get home position for tile
-   row1 = hposn[ii].row;
-   col1 = hposn[ii].col;
-   if (++col1 == Ncols) return;                                                  //  tile to the right, unless on edge
+   int key = event->keyval;
+   if (key == GDK_KEY_z && ! (event->state & GDK_SHIFT_MASK)) m_undo();
+   else if (key == GDK_KEY_y || key == GDK_KEY_Z || key == GDK_KEY_z) m_redo();
+   else return 0;
+   return 1;                                                                     //  handled
+}
+
+
+//  test puzzle before discarding, give user a chance to save
+//  returns  0 = completed, unchanged, or user says discard
+//           1 = incomplete, modified, and user says keep
+
+int puzzle_status()
+{
+   if (! Ntiles) return 0;                                                       //  no puzzle
+   if (! Nmoves) return 0;                                                       //  no new moves
+   if (Nhome == Ntiles) return 0;                                                //  puzzle done
+   if (zmessageYN(win1,ZTX("DISCARD unfinished puzzle?")))                       //  OK to discard
+      return 0;
+   return 1;                                                                     //  keep
+}
 
-   seed = row1 + col1;
-   px = int(0.2 * tileW + 0.5);
-   py = int(drand(seed,0.6) * tileH + 0.1 * tileH);
-   pw = int(0.2 * tileW + 0.5);
-   ph = int(0.2 * tileH + 0.5);
-   x2 = col2 * tileW + tileW - px;                                               //  hole position in window
-   y2 = row2 * tileH + py;
 
-   cairo_set_source_rgb(mwcr,0,0,0);                                             //  draw hole rectangle       gtk3
-   cairo_rectangle(mwcr,x2,y2,pw,ph);
-   cairo_fill(mwcr);
+//  thread function to display help file
 
+void m_help()                                                                    //  menu function
+{
+   showz_userguide();                                                            //  display help in new process
    return;
 }
 
 
-//  update statistics on status bar
+//  initialize puzzle from image file with optional preservation
+//  of existing tile data (row and column counts, tile positions)
+//  called by new_puzzle() and resume_puzzle()
 
-void stbar_update()
+void init_puzzle(int newp)
 {
-   char     message[50];
+   if (imagefile.length() == 0) return;
+   anim_stop();                                                                  //  tiles of prior puzzle
+   journal_clear();                                                              //  moves of prior puzzle
+
+   const char* pp = strrchr(imagefile.c_str(),'/');                                         //  puzzle name = image file name
+   if (! pp++) pp = imagefile.c_str();
+   pname = pp;
+
+   free_pyramid();                                                               //  prior image obsolete
+   free_atlas();
+   edge_index_free();
+   GError      *gerror = nullptr;
+   iPixbuf = gdk_pixbuf_new_from_file(imagefile.c_str(),&gerror);                        //  create pixbuf from image file
+   if (!iPixbuf) {
+      if (! win1) printf("image type not recognized: %s \n",imagefile.c_str());
+      else zmessageACK(win1,ZTX("image type not recognized:\n %s"),imagefile.c_str());
+      clear_puzzle();
+      return;
+   }
+
+   imageW = gdk_pixbuf_get_width(iPixbuf);                                       //  get image size
+   imageH = gdk_pixbuf_get_height(iPixbuf);
+
+   if (imageW < 300 || imageH < 300) {
+      if (! win1) printf("image too small: %s \n",imagefile.c_str());
+      else zmessageACK(win1,ZTX("image too small, please select another"));
+      clear_puzzle();
+      return;
+   }
+
+   build_pyramid();                                                              //  reduced image levels
+
+   tile_window(newp);                                                            //  paint tiles on main window
 
-   snprintf(message,sizeof(message), ZTX("tiles home: %d/%d"),Nhome,Ntiles);
-   if (Mstate > 1) snprintf(message,49,"%s  %s",message,ZTX("1st tile selected"));
-   stbar_message(stbar,message);
    return;
 }
 
 
-//  save current image directory upon exit, reload this upon startup             //  v.1.8
-//  directory is saved in file $HOME/.picpuz/image_directory
+//  release memory and clear all puzzle data
 
-void save_imagedirk()
+void clear_puzzle()
 {
-   shell_ack("echo %s > %s/image_directory",imagedirk.c_str(), get_zuserdir());
+   anim_stop();
+   journal_clear();
+   free_pyramid();
+   free_atlas();
+   edge_index_free();
+   if (rescale_timer) g_source_remove(rescale_timer);                            //  no pending HQ rescale
+   rescale_timer = 0;
+   rescale_gen++;
+   if (bcr) cairo_destroy(bcr);                                                  //  no board image
+   if (board) cairo_surface_destroy(board);
+   bcr = 0;
+   board = 0;
+   Ntiles = Nmoves = Nhome = 0;
+   stbar_update();
    return;
 }
 
-void load_imagedirk()
+
+//  Image pyramid: levels[N] is the image reduced by 2**N, down to about
+//  256 pixels. A thread builds the levels after the image file is loaded.
+//  Rescaling starts from the smallest level that is not smaller than the
+//  target, which touches a fraction of the pixels of the full size image.
+
+void build_pyramid()
 {
-   int      err;
-   FILE     *fid;
-   STATB    statdat;
-   char     dirbuff[XFCC], *pp;
+   void * pyramid_thread(void *);
 
-   pp = getcwd(dirbuff,XFCC-1);                                                //  default is current directory
-   imagedirk = dirbuff;
-   
-   snprintf(dirbuff,XFCC-1,"%s/image_directory",get_zuserdir());                 //  read saved file
-   fid = fopen(dirbuff,"r");
-   if (! fid) return;
-   pp = fgets_trim(dirbuff,XFCC-1,fid,1);
+   levels[0] = iPixbuf;
+   Nlevels = 1;
+   pyramid_stop = 0;
+   pyramid_gen++;
+
+   int err = pthread_create(&pyramid_tid,0,pyramid_thread,(void *) (intptr_t) pyramid_gen);
+   if (! err) pyramid_busy = 1;
+
+   if (pyramid_busy && ! dwin1) {                                                //  no GUI: wait for all levels,
+      pthread_join(pyramid_tid,0);                                               //    output does not depend on timing
+      pyramid_busy = 0;
+   }
+   return;
+}
+
+
+//  thread function: build levels 1, 2, ... from the prior level
+
+void * pyramid_thread(void *arg)
+{
+   int pyramid_done(void *arg);
+
+   PIXBUF   *pxb1, *pxb2;
+   int      ww, hh;
+
+   for (int nn = 1; nn < maxlevels; nn++)
+   {
+      if (pyramid_stop) break;
+      pxb1 = levels[nn-1];
+      ww = gdk_pixbuf_get_width(pxb1) / 2;
+      hh = gdk_pixbuf_get_height(pxb1) / 2;
+      if (ww < 256 || hh < 256) break;
+      pxb2 = zpixbuf_scale(pxb1,ww,hh,ZSCALE_BOX);                               //  2x2 pixel average
+      if (! pxb2) break;
+      mutex_lock(&pyramid_lock);
+      levels[nn] = pxb2;
+      Nlevels = nn + 1;
+      mutex_unlock(&pyramid_lock);
+   }
+
+   g_idle_add(pyramid_done,arg);                                                 //  finish in main thread
+   return 0;
+}
+
+
+//  main thread: pyramid complete, release full size image if memory is tight
+
+int pyramid_done(void *arg)
+{
+   FILE     *fid;
+   char     buff[100];
+   double   memavail = 0, imagemem;
+
+   if ((intptr_t) arg != pyramid_gen) return 0;                                  //  obsolete image
+   if (! pyramid_busy) return 0;
+   pthread_join(pyramid_tid,0);
+   pyramid_busy = 0;
+
+   if (Nlevels < 2 || ! levels[0]) return 0;
+
+   fid = fopen("/proc/meminfo","r");                                             //  get available memory
+   if (! fid) return 0;
+   while (fgets(buff,100,fid))
+      if (strmatchN(buff,"MemAvailable:",13))
+         memavail = 1024.0 * atof(buff+13);
    fclose(fid);
-   if (! pp) return;
-   err = stat(dirbuff,&statdat);                                                 //  contains a valid directory name?
-   if (err) return;
-   if (! S_ISDIR(statdat.st_mode)) return;
-   imagedirk = dirbuff;                                                    //  yes, use it
+
+   imagemem = 1.0 * gdk_pixbuf_get_rowstride(levels[0]) * imageH;
+   if (memavail == 0 || imagemem < 0.25 * memavail) return 0;                    //  memory is OK
+
+   if (debug) printf("full size image released: %.0f MB \n",imagemem/1e6);
+   g_object_unref(levels[0]);                                                    //  level 1 replaces full size
+   levels[0] = 0;
+   iPixbuf = levels[1];
+   return 0;
+}
+
+
+//  stop the build thread and release all image levels
+
+void free_pyramid()
+{
+   pyramid_stop = 1;
+   if (pyramid_busy) pthread_join(pyramid_tid,0);
+   pyramid_busy = 0;
+
+   if (Nlevels == 0 && iPixbuf) g_object_unref(iPixbuf);                         //  no pyramid yet
+   for (int nn = 0; nn < Nlevels; nn++)
+      if (levels[nn]) g_object_unref(levels[nn]);
+   for (int nn = 0; nn < maxlevels; nn++) levels[nn] = 0;
+   Nlevels = 0;
+   iPixbuf = 0;
+   return;
+}
+
+
+//  get the smallest image level at least as large as ww x hh
+//  (the largest level available if all are smaller)
+
+PIXBUF * image_level(int ww, int hh)
+{
+   PIXBUF   *pxb = iPixbuf;
+
+   mutex_lock(&pyramid_lock);
+   for (int nn = Nlevels-1; nn >= 0; nn--) {
+      if (! levels[nn]) continue;
+      if (gdk_pixbuf_get_width(levels[nn]) < ww) continue;
+      if (gdk_pixbuf_get_height(levels[nn]) < hh) continue;
+      pxb = levels[nn];
+      break;
+   }
+   mutex_unlock(&pyramid_lock);
+   return pxb;
+}
+
+
+//  create tile pixmaps and paint tiles on window
+//  called by init_puzzle(), retile_puzzle(), winpaint()
+//  newp: 0 = same tiles, 1 = new puzzle, 2 = window resize (preview first)
+
+void tile_window(int newp)
+{
+   int rescale_timeout(void *);
+
+   if (! iPixbuf) return;
+
+   if (dwin1) {                                                                  //  window size
+      allocW = gtk_widget_get_allocated_width(dwin1);                            //  (no GUI: set by caller)
+      allocH = gtk_widget_get_allocated_height(dwin1);
+   }
+
+   winW = allocW - 4;                                                            //  to keep margins visible
+   winH = allocH - 4;
+
+   int x1 = int(1.0 * winH * imageW / imageH);                                       //  preserve image X/Y ratio
+   if (winW > x1) winW = x1;
+   int y1 = int(1.0 * winW * imageH / imageW);
+   if (winH > y1) winH = y1;
+
+   if (newp == 1)                                                                //  new puzzle
+   {
+      Ncols = int(1.0 * winW / tileU + 0.5);                                     //  best fit to user tile size
+      Nrows = int(1.0 * winH / tileU + 0.5);
+      Ntiles = Nrows * Ncols;
+
+      pstate.init(Ntiles);                                                       //  all window positions = home
+      journal_clear();
+   }
+
+   if (newp != 2) autosave_checkpoint();                                         //  new or resumed puzzle
+
+   pstate.set_hposn();                                                           //  home tiles from window positions
+   misplaced_init();                                                             //  misplaced tiles, Nhome
+   groups_init();                                                                //  joined tile groups
+
+   tileW = winW / Ncols;                                                         //  actual tile size to use
+   tileH = winH / Nrows;
+
+   winW = Ncols * tileW;                                                         //  synch. window to tile size
+   winH = Nrows * tileH;
+
+   if (newp == 1 || ! atlas || atlasW != tileW || atlasH != tileH                     //  new puzzle or tile size changed,
+            || ! wSurface || cairo_image_surface_get_width(wSurface) != winW     //    rescale image, rebuild tile atlas
+            || cairo_image_surface_get_height(wSurface) != winH)
+   {
+      rescale_gen++;                                                             //  obsolete pending HQ rescales
+      if (rescale_timer) g_source_remove(rescale_timer);
+      rescale_timer = 0;
+
+      if (newp == 2) {                                                           //  window resize in progress:
+         set_window_image(window_image(image_level(winW,winH),winW,winH,1));      //    fast preview image,
+                                                                                 //    HQ image when size is stable
+         rescale_timer = g_timeout_add(150,rescale_timeout,0);
+         Npreview++;
+      }
+      else set_window_image(window_image(image_level(winW,winH),winW,winH,0));   //  scale image to window size
+
+      if (! board || cairo_image_surface_get_width(board) != winW                //  new board image
+                  || cairo_image_surface_get_height(board) != winH) {
+         if (bcr) cairo_destroy(bcr);
+         if (board) cairo_surface_destroy(board);
+         board = cairo_image_surface_create(CAIRO_FORMAT_RGB24,winW,winH);
+         bcr = cairo_create(board);
+      }
+   }
+
+   redraw_all();                                                                 //  tiles drawn at next paint
+   hint_show(-1,-1);
+   if (! rescale_timer) edge_index_start();                                      //  edge index for HQ image
+
+   Mstate = 0;                                                                   //  no tile selected
+   Gsel.clear();
+   stbar_update();                                                               //  update status bar
+   return;
+}
+
+
+//  Window resize: GTK sends a burst of size allocations while the window
+//  edge is dragged. Each one gets a fast nearest-pixel preview image.
+//  When the size has been stable for 150 ms, the high quality image is
+//  made by a thread and replaces the preview. An image obsoleted by a
+//  later resize or a new puzzle (rescale_gen changed) is discarded.
+
+struct rescale_job_t {
+   PIXBUF            *pxb;                                                       //  source image level
+   cairo_surface_t   *surf;                                                      //  result
+   int               ww, hh;                                                     //  window image size
+   int               gen;                                                        //  rescale_gen at start
+};
+
+
+//  timeout function: window size stable, start HQ rescale thread
+
+int rescale_timeout(void *)
+{
+   void * rescale_thread(void *);
+
+   rescale_timer = 0;
+   if (! Ntiles || ! iPixbuf) return 0;
+
+   if (Npreview > 1) Navoided += Npreview - 1;                                   //  1 full rescale, not Npreview
+   if (debug) printf("resize: %d previews, %d full rescales avoided \n",Npreview,Navoided);
+   Npreview = 0;
+
+   rescale_job_t *job = new rescale_job_t;
+   job->pxb = image_level(winW,winH);
+   g_object_ref(job->pxb);                                                       //  keep if pyramid is freed
+   job->ww = winW;
+   job->hh = winH;
+   job->gen = rescale_gen;
+   start_detached_thread(rescale_thread,job);
+   return 0;                                                                     //  one shot
+}
+
+
+//  thread function: HQ rescale, finish in main thread
+
+void * rescale_thread(void *arg)
+{
+   int rescale_done(void *);
+
+   rescale_job_t *job = (rescale_job_t *) arg;
+   job->surf = window_image(job->pxb,job->ww,job->hh,0);
+   g_object_unref(job->pxb);
+   g_idle_add(rescale_done,job);
+   return 0;
+}
+
+
+//  main thread: replace the preview image if still current
+
+int rescale_done(void *arg)
+{
+   rescale_job_t *job = (rescale_job_t *) arg;
+
+   if (job->surf) {
+      if (job->gen == rescale_gen && Ntiles                                      //  window not resized since
+             && job->ww == winW && job->hh == winH) {
+         set_window_image(job->surf);
+         redraw_all();
+         edge_index_start();
+      }
+      else cairo_surface_destroy(job->surf);                                     //  obsolete
+   }
+
+   delete job;
+   return 0;
+}
+
+
+//  scale an image level to the window size, fast or high quality, and
+//  convert to a cairo surface for tile atlas painting (thread safe)
+
+cairo_surface_t * window_image(PIXBUF *pxb, int ww, int hh, int fast)
+{
+   PIXBUF            *pxb2;
+   cairo_surface_t   *surf;
+
+   if (fast) pxb2 = gdk_pixbuf_scale_simple(pxb,ww,hh,GDK_INTERP_NEAREST);
+   else pxb2 = zpixbuf_scale(pxb,ww,hh);
+   if (! pxb2) return 0;
+   surf = zpixbuf_surface(pxb2);                                                 //  RGB pixels not kept
+   g_object_unref(pxb2);
+   return surf;
+}
+
+
+//  replace the window image and rebuild the tile atlas from it
+
+void set_window_image(cairo_surface_t *surf)
+{
+   if (! surf) return;
+   if (wSurface) cairo_surface_destroy(wSurface);
+   wSurface = surf;
+   build_atlas();
+   return;
+}
+
+
+//  process mouse events (button down, button up)
+//  Shift + 1st tile: select the tile's joined group, 2nd tile: move group
+
+void mouse_event(GtkWidget *, GdkEventButton *event)
+{
+   static int  row1, col1, row2, col2;
+
+   if (! Ntiles) return;
+   hint_show(-1,-1);                                                             //  remove hint outline
+
+   int button = event->button;                                                       //  1/2/3 = left/middle/right
+   int x = int(event->x);
+   int y = int(event->y);
+
+   if (x < 1 || x >= (Ncols * tileW)) goto mret0;                                //  ignore if not within picture
+   if (y < 1 || y >= (Nrows * tileH)) goto mret0;
+
+   if (button == 3) {                                                            //  if right button,
+      row1 = y / tileH;                                                          //    get tile belonging here
+      col1 = x / tileW;
+      int posn = pstate.wposn(Tindex(row1,col1));
+      row2 = posn / Ncols;                                                       //  where it is now
+      col2 = posn % Ncols;
+      swap_tiles(row1,col1,row2,col2);                                           //  swap
+      goto mret0;
+   }
+
+   if (Mstate < 2) {                                                             //  1st tile selection
+      row1 = y / tileH;
+      col1 = x / tileW;
+      if (Mstate == 0 && (event->state & GDK_SHIFT_MASK)) {
+         anim_finish();                                                          //  no moves before the drop
+         group_select(row1,col1);                                                //  group selection
+      }
+   }
+
+   else {                                                                        //  2nd tile selection
+      row2 = y / tileH;
+      col2 = x / tileW;
+   }
+
+   Mstate++;
+
+   if (Mstate < 4) goto mret;
+   if (Gsel.size()) group_move(row2-row1,col2-col1);                             //  last button up
+   else swap_tiles(row1,col1,row2,col2);
+
+mret0:
+   Mstate = 0;
+   Gsel.clear();
+
+mret:
+   stbar_update();                                                               //  update status bar
+   return;
+}
+
+
+//  swap two tile positions on window
+
+void swap_tiles(int row1, int col1, int row2, int col2)
+{
+   void swap2(int, int, int, int);                                               //  private functions
+   void swap3(int, int, int, int);
+
+   journal_action();                                                             //  swaps below are undone together
+   swap2(row1,col1,row2,col2);                                                   //  swap the two tiles
+   swap3(row1,col1,row2,col2);                                                   //  move adjacent tiles home
+   swap3(row2,col2,row1,col1);                                                   //  move adjacent tiles home
+   return;
+}
+
+
+//  perform the swap of the two tiles only
+
+void swap2(int row1, int col1, int row2, int col2)
+{
+   if (! Ntiles) return;
+   if (row1 == row2 && col1 == col2) return;
+
+   void groups_join(int posn);
+
+   static vector<int>   seeds;
+   int   adj[4] = { -Ncols, -1, +1, +Ncols };
+
+   int ii1 = Tindex(row1,col1);                                                  //  swap tiles at window positions
+   int ii2 = Tindex(row2,col2);                                                  //    (row1,col1) and (row2,col2)
+
+   if (Gsel.size()) {                                                            //  selected group positions
+      Gsel.clear();                                                              //    are stale, cancel
+      Mstate = 0;
+   }
+
+   seeds.clear();                                                                //  moving a joined tile may split
+   for (int jj = 0; jj < 4; jj++) {                                              //    its group
+      if (joined(ii1,ii1+adj[jj])) seeds.push_back(pstate.hposn(ii1+adj[jj]));
+      if (joined(ii2,ii2+adj[jj])) seeds.push_back(pstate.hposn(ii2+adj[jj]));
+   }
+   if (seeds.size()) {
+      seeds.push_back(pstate.hposn(ii1));
+      seeds.push_back(pstate.hposn(ii2));
+   }
+
+   if (hintP1 >= 0) hint_show(-1,-1);                                            //  hint obsolete
+   pstate.swap(ii1,ii2);
+
+   if (seeds.size()) groups_split(seeds);                                        //  groups of the broken joins
+   groups_join(ii1);                                                             //  join new neighbors
+   groups_join(ii2);
+
+   if (! Jreplay) journal_add(ii1,ii2);                                          //  add to move journal
+   autosave_swap(ii1,ii2);
+
+   misplaced_update(pstate.hposn(ii1));                                          //  home tiles moved
+   misplaced_update(pstate.hposn(ii2));
+   Nhome = Ntiles - Mtiles.size();
+
+   damage_tile(row1,col1);                                                       //  redraw tiles at new positions
+   damage_tile(row2,col2);                                                       //    in next frame
+
+   Nmoves++;                                                                     //  incr. move count
+   return;
+}
+
+
+//  Joined tile groups: tiles at adjacent window positions are joined if
+//  their home positions are adjacent in the same direction. A union-find
+//  keeps the groups: Gnode[tile] is a node, nodes are linked to a root
+//  node per group. Joins made by swap2() are unions, near O(1). A move
+//  that breaks a join may split a group, which a union-find cannot do:
+//  groups_split() searches the parts, and the smaller parts get new nodes.
+//  A rearrangement of the whole board (mix) rebuilds all groups.
+
+int joined(int posn1, int posn2)                                                 //  posn2 is adjacent to posn1
+{
+   if (posn2 < 0 || posn2 >= Ntiles) return 0;                                  //  off the board
+   int dd = posn2 - posn1;
+   if (dd == 1 || dd == -1)                                                      //  horizontal neighbors
+      if (posn1 / Ncols != posn2 / Ncols) return 0;                              //    must be in the same row
+   int tile1 = pstate.hposn(posn1);
+   int tile2 = pstate.hposn(posn2);
+   if (tile2 - tile1 != dd) return 0;                                            //  homes not adjacent the same way
+   if (dd == 1 || dd == -1)
+      if (tile1 / Ncols != tile2 / Ncols) return 0;
+   return 1;
+}
+
+
+int group_find(int tile)
+{
+   uint32   node = Gnode[tile];
+
+   while (Gparent[node] != node) {                                               //  path halving
+      Gparent[node] = Gparent[Gparent[node]];
+      node = Gparent[node];
+   }
+   return node;
+}
+
+
+void group_union(int tile1, int tile2)
+{
+   int root1 = group_find(tile1);
+   int root2 = group_find(tile2);
+   if (root1 == root2) return;
+
+   if (Gsize[root1] < Gsize[root2]) std::swap(root1,root2);                      //  union by size
+   Gparent[root2] = root1;
+   Gcount[Gsize[root1]]--;
+   Gcount[Gsize[root2]]--;
+   Gsize[root1] += Gsize[root2];
+   Gcount[Gsize[root1]]++;
+   if ((int) Gsize[root1] > Gmax) Gmax = Gsize[root1];
+   Njoined = Ntiles - Gcount[1];                                                 //  tiles not single
    return;
 }
 
 
+//  union the tile at window position posn with its joined neighbors
+
+void groups_join(int posn)
+{
+   int adj[4] = { -Ncols, -1, +1, +Ncols };
+
+   for (int jj = 0; jj < 4; jj++)
+      if (joined(posn,posn+adj[jj]))
+         group_union(pstate.hposn(posn),pstate.hposn(posn+adj[jj]));
+   return;
+}
+
+
+//  rebuild all groups, O(Ntiles)
+
+void groups_init()
+{
+   Gnode.resize(Ntiles);
+   Gparent.resize(Ntiles);
+   Gsize.assign(Ntiles,1);
+   Gcount.assign(Ntiles+1,0);
+   Gcount[1] = Ntiles;
+   for (int ii = 0; ii < Ntiles; ii++) Gnode[ii] = Gparent[ii] = ii;
+   Njoined = 0;
+   Gmax = Ntiles ? 1 : 0;
+
+   for (int posn = 0; posn < Ntiles; posn++)                                     //  join right and lower neighbors
+   {
+      if (joined(posn,posn+1)) group_union(pstate.hposn(posn),pstate.hposn(posn+1));
+      if (joined(posn,posn+Ncols)) group_union(pstate.hposn(posn),pstate.hposn(posn+Ncols));
+   }
+
+   return;
+}
+
+
+//  Joins were broken: seeds = home tiles on both sides of each broken
+//  join, now at their new positions. Every part of a split group has a
+//  seed tile. A search from each seed runs one step at a time in turn,
+//  and searches that meet are merged. When only one search is not done,
+//  it is the largest part, which keeps its nodes. The tiles of the other
+//  parts are moved to a new node per part. Cost is about the number of
+//  seeds times the size of the smaller parts, not the group size:
+//  a tile taken out of a group of 1M tiles is found as 1 tile.
+
+void groups_split(const vector<int> &seeds)
+{
+   static vector<vector<int>>    done, todo;                                     //  per search: positions searched,
+   static vector<int>            srep;                                           //    to search, merged to search
+   int            adj[4] = { -Ncols, -1, +1, +Ncols };
+   int            ss, oo, jj, posn, posn2, Ns = 0, Nactive;
+   uint32         base, node, root, size;
+
+   visit_new(seeds.size());                                                      //  Tvisit = base + search
+   base = Vgen - seeds.size() + 1;
+   if (done.size() < seeds.size()) {
+      done.resize(seeds.size());
+      todo.resize(seeds.size());
+      srep.resize(seeds.size());
+   }
+
+   for (int tile : seeds) {                                                      //  one search per seed
+      posn = pstate.wposn(tile);
+      if (Tvisit[posn] >= base) continue;
+      Tvisit[posn] = base + Ns;
+      done[Ns].clear();
+      todo[Ns].assign(1,posn);
+      srep[Ns] = Ns;
+      Ns++;
+   }
+
+   for (Nactive = Ns; Nactive > 1; )
+   {
+      for (ss = 0; ss < Ns; ss++)                                                //  one step of each search
+      {
+         if (srep[ss] != ss || todo[ss].empty()) continue;                       //  merged or done
+         posn = todo[ss].back();
+         todo[ss].pop_back();
+         done[ss].push_back(posn);
+
+         for (jj = 0; jj < 4; jj++)
+         {
+            posn2 = posn + adj[jj];
+            if (! joined(posn,posn2)) continue;
+            if (Tvisit[posn2] < base) {                                          //  new tile for this search
+               Tvisit[posn2] = base + ss;
+               todo[ss].push_back(posn2);
+               continue;
+            }
+            for (oo = Tvisit[posn2] - base; srep[oo] != oo; oo = srep[oo]);     //  found by another search
+            if (oo == ss) continue;
+            if (done[oo].size() > done[ss].size()) {                             //  merge, smaller into larger
+               std::swap(done[oo],done[ss]);
+               std::swap(todo[oo],todo[ss]);
+            }
+            done[ss].insert(done[ss].end(),done[oo].begin(),done[oo].end());
+            todo[ss].insert(todo[ss].end(),todo[oo].begin(),todo[oo].end());
+            done[oo].clear();
+            todo[oo].clear();
+            srep[oo] = ss;
+         }
+      }
+
+      Nactive = 0;
+      for (ss = 0; ss < Ns; ss++)
+         if (srep[ss] == ss && todo[ss].size()) Nactive++;
+   }
+
+   for (ss = 0; ss < Ns; ss++)                                                   //  searches done: new group each
+   {
+      if (srep[ss] != ss || todo[ss].size()) continue;                           //  merged, or the part kept
+      size = done[ss].size();
+      node = Gparent.size();
+      Gparent.push_back(node);
+      Gsize.push_back(size);
+      for (int posn : done[ss]) {
+         int tile = pstate.hposn(posn);
+         root = group_find(tile);                                                //  tile leaves its old group
+         Gcount[Gsize[root]]--;
+         Gsize[root]--;
+         Gcount[Gsize[root]]++;                                                  //  ([0] = empty old groups)
+         Gnode[tile] = node;
+      }
+      Gcount[size]++;
+      if ((int) size > Gmax) Gmax = size;
+   }
+
+   Njoined = Ntiles - Gcount[1];
+   while (Gmax > 1 && ! Gcount[Gmax]) Gmax--;                                    //  no more than the old group sizes
+   if ((int) Gparent.size() > 2 * Ntiles) groups_init();                         //  too many unused nodes
+   return;
+}
+
+
+//  Move journal: a ring buffer of the window position pairs swapped by
+//  swap2(), oldest entries overwritten. The first swap of each user
+//  action (a click with its cluster moves) is flagged, and undo or redo
+//  replays all swaps of one action. A swap is its own inverse, so undo
+//  repeats the swaps of the action in reverse order.
+
+void journal_action()
+{
+   Jaction = 1;
+   return;
+}
+
+
+void journal_clear()
+{
+   Jfirst = Jend = Jtop = 0;
+   Jaction = 1;
+   Jskip = 0;
+   return;
+}
+
+
+//  add a swap of window positions ii1, ii2
+
+void journal_add(int ii1, int ii2)
+{
+   if (Jaction) Jskip = 0;                                                       //  new action
+   else if (Jskip) return;                                                       //  rest of oversize action
+
+   if (Jtop > Jend) Jtop = Jend;                                                 //  undone moves are obsolete
+   uint32 *jj = Jposn[Jend % Jmax];
+   jj[0] = ii1 | (Jaction ? Jstart : 0);
+   jj[1] = ii2;
+   Jaction = 0;
+   Jtop = ++Jend;
+
+   if (Jend - Jfirst > Jmax) {                                                   //  full, drop oldest action
+      Jfirst = Jend - Jmax;
+      while (Jfirst < Jend && ! (Jposn[Jfirst % Jmax][0] & Jstart)) Jfirst++;
+      if (Jfirst == Jend) Jskip = 1;                                             //  action bigger than journal,
+   }                                                                             //    cannot be undone
+   return;
+}
+
+
+//  undo the last action
+
+void m_undo()
+{
+   uint32   *jj;
+
+   anim_finish();
+   if (Jend == Jfirst) return;                                                   //  nothing to undo
+
+   Jreplay = 1;
+   do {
+      jj = Jposn[--Jend % Jmax];
+      int ii1 = jj[0] & ~Jstart;
+      swap2(ii1/Ncols,ii1%Ncols,jj[1]/Ncols,jj[1]%Ncols);
+   } while (! (jj[0] & Jstart) && Jend > Jfirst);
+   Jreplay = 0;
+
+   Mstate = 0;                                                                   //  no tile selected
+   Gsel.clear();
+   stbar_update();
+   return;
+}
+
+
+//  redo the last undone action
+
+void m_redo()
+{
+   uint32   *jj;
+
+   anim_finish();
+   if (Jend == Jtop) return;                                                     //  nothing to redo
+
+   Jreplay = 1;
+   do {
+      jj = Jposn[Jend++ % Jmax];
+      int ii1 = jj[0] & ~Jstart;
+      swap2(ii1/Ncols,ii1%Ncols,jj[1]/Ncols,jj[1]%Ncols);
+   } while (Jend < Jtop && ! (Jposn[Jend % Jmax][0] & Jstart));
+   Jreplay = 0;
+
+   Mstate = 0;
+   Gsel.clear();
+   stbar_update();
+   return;
+}
+
+
+//  Rearrange many tiles at once: put tiles[k] at window position posns[k],
+//  k = 0 to N-1. The tiles must be those now at the given positions, in
+//  any order. The tile maps are updated in one pass, Nhome once, and the
+//  moved tiles are repainted in the next frame. Cost is O(N).
+//  journal: record the rearrangement as one undo action, else clear the
+//  journal (prior moves can no longer be undone).
+
+void move_tiles(const int *posns, const int *tiles, int N, int journal)
+{
+   std::unordered_map<int,int>   newposn;                                        //  old position -> new position
+   vector<int>    seeds;                                                         //  tiles of broken joins
+   int            kk, Nmoved = 0, adj[4] = { -Ncols, -1, +1, +Ncols };
+
+   for (kk = 0; kk < N; kk++)
+      if (pstate.hposn(posns[kk]) != tiles[kk]) Nmoved++;
+   if (! Nmoved) return;
+
+   if (Gsel.size()) {                                                            //  selected group positions
+      Gsel.clear();                                                              //    are stale, cancel
+      Mstate = 0;
+   }
+
+   if (journal) {
+      newposn.reserve(N);
+      for (kk = 0; kk < N; kk++)
+         newposn[pstate.wposn(tiles[kk])] = posns[kk];
+   }
+
+   for (kk = 0; kk < N && journal; kk++)                                         //  a join is kept if both tiles
+   {                                                                             //    move the same way, else
+      int posn1 = pstate.wposn(tiles[kk]);                                       //      the group may split
+      for (int jj = 0; jj < 4; jj++) {
+         int posn2 = posn1 + adj[jj];
+         if (! joined(posn1,posn2)) continue;
+         auto it = newposn.find(posn2);
+         int new2 = (it == newposn.end()) ? posn2 : it->second;
+         if (new2 - posns[kk] == adj[jj]) continue;
+         seeds.push_back(tiles[kk]);
+         seeds.push_back(pstate.hposn(posn2));
+      }
+   }
+
+   if (journal) {                                                                //  cycle p0 > p1 > ... > p0
+      journal_action();                                                          //    = swaps (p0,p1) (p0,p2) ...
+      for (auto &it : newposn) {
+         int posn0 = it.first;
+         int posn = it.second;
+         if (posn == posn0 || posn < 0) continue;                                //  not moved or cycle done
+         while (posn != posn0) {
+            journal_add(posn0,posn);
+            autosave_swap(posn0,posn);
+            int next = newposn[posn];
+            newposn[posn] = -1;                                                  //  mark done
+            posn = next;
+         }
+         it.second = -1;
+      }
+   }
+   else {
+      journal_clear();
+      autosave_checkpoint();                                                     //  many tiles, save all
+   }
+
+   if (hintP1 >= 0) hint_show(-1,-1);                                            //  hint obsolete
+   for (kk = 0; kk < N; kk++)
+      pstate.place(posns[kk],tiles[kk]);
+
+   for (kk = 0; kk < N; kk++)
+      misplaced_update(tiles[kk]);
+   Nhome = Ntiles - Mtiles.size();
+   Nmoves += Nmoved;
+
+   if (! journal) groups_init();                                                 //  many tiles, rebuild groups
+   else {
+      if (seeds.size()) groups_split(seeds);                                     //  groups of the broken joins
+      for (kk = 0; kk < N; kk++) groups_join(posns[kk]);                         //  join new neighbors
+   }
+
+   if (Nmoved > Ntiles / 4) redraw_all();
+   else damage_tiles(posns,N);
+   return;
+}
+
+
+//  mark tiles for redraw and queue one window repaint covering all of them
+
+void damage_tiles(const int *posns, int N)
+{
+   int   row, col, row1 = Nrows, row2 = -1, col1 = Ncols, col2 = -1;
+
+   for (int kk = 0; kk < N; kk++)
+   {
+      int ii = posns[kk];
+      if (! Tdirty[ii]) {
+         Tdirty[ii] = 1;
+         Ndirty++;
+      }
+      row = ii / Ncols;
+      col = ii % Ncols;
+      if (row < row1) row1 = row;
+      if (row > row2) row2 = row;
+      if (col < col1) col1 = col;
+      if (col > col2) col2 = col;
+   }
+
+   if (row2 < 0 || ! dwin1) return;
+
+   int pw = int(0.2 * tileW + 0.5);                                              //  lobes of tiles to the left
+   int x1 = col1 * tileW - pw;
+   int x2 = col2 * tileW + tileW;
+   if (x1 < 0) x1 = 0;
+   gtk_widget_queue_draw_area(dwin1,x1,row1*tileH,x2-x1,(row2-row1+1)*tileH);
+   return;
+}
+
+
+//  Group moves: Shift+click selects the joined group of a tile, a click
+//  on another tile moves the group there (the clicked group tile to the
+//  clicked position). Tiles in the way go to the vacated positions,
+//  shifted back along the move direction so their arrangement is kept.
+//  Cost is proportional to the group size. Any other move between the
+//  clicks (undo, animation) cancels the selection.
+
+void group_select(int row, int col)
+{
+   int   adj[4] = { -Ncols, -1, +1, +Ncols };
+
+   visit_new();                                                                  //  breadth first search
+   Gsel.clear();
+   Gsel.push_back(Tindex(row,col));
+   Tvisit[Gsel[0]] = Vgen;
+
+   for (int kk = 0; kk < (int) Gsel.size(); kk++)
+   for (int jj = 0; jj < 4; jj++)
+   {
+      int posn = Gsel[kk] + adj[jj];
+      if (! joined(Gsel[kk],posn)) continue;
+      if (Tvisit[posn] == Vgen) continue;
+      Tvisit[posn] = Vgen;
+      Gsel.push_back(posn);
+   }
+
+   return;
+}
+
+
+//  move the selected group by drow, dcol
+//  returns 0 if the group would not fit on the board
+
+int group_move(int drow, int dcol)
+{
+   vector<int>    posns, tiles;
+   int            kk, posn, row, col;
+   int            dd = drow * Ncols + dcol;
+   int            NG = Gsel.size();
+
+   if (! dd || ! NG) return 0;
+
+   for (kk = 0; kk < NG; kk++) {                                                 //  check new positions
+      row = Gsel[kk] / Ncols + drow;
+      col = Gsel[kk] % Ncols + dcol;
+      if (row < 0 || row >= Nrows || col < 0 || col >= Ncols) return 0;
+   }
+
+   visit_new();                                                                  //  mark group positions
+   for (kk = 0; kk < NG; kk++) Tvisit[Gsel[kk]] = Vgen;
+
+   for (kk = 0; kk < NG; kk++) {                                                 //  group tiles to new positions
+      posns.push_back(Gsel[kk] + dd);
+      tiles.push_back(pstate.hposn(Gsel[kk]));
+   }
+
+   for (kk = 0; kk < NG; kk++)                                                   //  tiles in the way
+   {
+      posn = Gsel[kk] + dd;
+      if (Tvisit[posn] == Vgen) continue;                                        //  group tile, moves itself
+      tiles.push_back(pstate.hposn(posn));
+      row = posn / Ncols - drow;                                                 //  back along move direction
+      col = posn % Ncols - dcol;                                                 //    to a vacated position
+      while (row-drow >= 0 && row-drow < Nrows && col-dcol >= 0 && col-dcol < Ncols
+               && Tvisit[Tindex(row-drow,col-dcol)] == Vgen) {
+         row -= drow;
+         col -= dcol;
+      }
+      posns.push_back(Tindex(row,col));
+   }
+
+   Gsel.clear();                                                                 //  done with selection
+   move_tiles(&posns[0],&tiles[0],posns.size(),1);                               //  one batch, one undo action
+   return 1;
+}
+
+
+//  Set of misplaced tiles: Mtiles[*] = home tile index, Mposn[tile]
+//  = position in Mtiles or -1. Insert, remove, random pick are O(1).
+
+void misplaced_init()
+{
+   Mtiles.clear();
+   Mposn.assign(Ntiles,-1);
+   for (int ii = 0; ii < Ntiles; ii++) misplaced_update(ii);
+   Nhome = Ntiles - Mtiles.size();
+   return;
+}
+
+
+//  add or remove home tile ii after it was moved
+
+void misplaced_update(int ii)
+{
+   int   kk, last;
+   int   home = (pstate.wposn(ii) == ii);
+
+   if (! home && Mposn[ii] < 0) {                                                //  add to set
+      Mposn[ii] = Mtiles.size();
+      Mtiles.push_back(ii);
+   }
+
+   else if (home && Mposn[ii] >= 0) {                                            //  remove from set:
+      kk = Mposn[ii];                                                            //    last entry fills the gap
+      last = Mtiles.back();
+      Mtiles[kk] = last;
+      Mposn[last] = kk;
+      Mtiles.pop_back();
+      Mposn[ii] = -1;
+   }
+
+   return;
+}
+
+
+//  When a tile is moved to its home position, find all adjoining tiles
+//  that will also be home if moved in parallel with the first tile.
+//  (move home a cluster of fitting tiles all of which are "off by N")
+//  A tile is in the cluster if Tvisit[tile] == Vgen, so the visited array
+//  is not cleared for each call. Cost is proportional to the cluster size.
+
+void swap3(int row1, int col1, int row2, int col2)
+{
+   int      jj, drow, dcol, Nqueue, Equeue;
+   int      iix, iiy, rowx, colx, rowy, coly;
+   int      adjrow[4] = { -1, 0, 0, +1 };
+   int      adjcol[4] = { 0, -1, +1, 0 };
+
+   int ii1 = Tindex(row1,col1);
+   if (! pstate.home(ii1))                                                       //  if tile1 not at home,
+      return;                                                                    //    nothing to do
+
+   drow = row2 - row1;
+   dcol = col2 - col1;
+
+   visit_new();
+
+   Tqueue[0] = ii1;
+   Tvisit[ii1] = Vgen;
+   Nqueue = 1;
+   Equeue = 0;
+
+   while (Equeue < Nqueue)                                                       //  breadth first search
+   {
+      row1 = Tqueue[Equeue] / Ncols;
+      col1 = Tqueue[Equeue] - row1 * Ncols;
+      Equeue++;
+
+      for (jj = 0; jj < 4; jj++)
+      {
+         rowx = row1 + adjrow[jj];                                               //  tilex is adjoining a tile
+         colx = col1 + adjcol[jj];                                               //    that was moved to home
+         if (rowx < 0 || colx < 0) continue;                                     //  skip if out of bounds
+         if (rowx == Nrows || colx == Ncols) continue;
+
+         rowy = rowx + drow;                                                     //  corresponding tiley where
+         coly = colx + dcol;                                                     //    home tile was moved from
+         if (rowy < 0 || coly < 0) continue;                                     //  skip if out of bounds
+         if (rowy == Nrows || coly == Ncols) continue;
+
+         iix = Tindex(rowx,colx);
+         if (Tvisit[iix] == Vgen) continue;                                      //  tilex already in cluster
+
+         iiy = Tindex(rowy,coly);
+         if (pstate.hposn(iiy) == iix) {                                         //  tiley home = tilex position?
+            Tvisit[iix] = Vgen;                                                  //  yes, add tilex to cluster
+            Tqueue[Nqueue++] = iix;
+         }
+      }
+   }
+
+   for (Equeue = 0; Equeue < Nqueue; Equeue++)                                   //  move home tiles into cluster
+   {                                                                             //  (a swap never moves a tile
+      iix = Tqueue[Equeue];                                                      //    that is home, so one pass
+      rowx = iix / Ncols;                                                        //    is enough)
+      colx = iix - rowx * Ncols;
+      if (pstate.home(iix)) continue;                                            //  already home
+      iiy = pstate.wposn(iix);                                                   //  swap with position of home tile
+      swap2(rowx,colx,iiy/Ncols,iiy%Ncols);
+   }
+
+   return;
+}
+
+
+//  start a new generation of visited tiles (Tvisit[*] != Vgen), or Ngen
+//  new generations Vgen-Ngen+1 ... Vgen (all Tvisit[*] less)
+
+void visit_new(int Ngen)
+{
+   if ((int) Tvisit.size() != Ntiles) {                                          //  new puzzle size
+      Tvisit.assign(Ntiles,0);
+      Tqueue.resize(Ntiles);
+      Vgen = 0;
+   }
+
+   if (Vgen > 0xffffffffU - Ngen) {                                              //  generation wrap-around
+      Tvisit.assign(Ntiles,0);
+      Vgen = 0;
+   }
+   Vgen += Ngen;
+   return;
+}
+
+
+//  draw tile at window position (row, col)
+
+void draw_tile(int row, int col)
+{
+   void  draw_body(int row, int col);
+   void  draw_lobe(int row, int col);
+
+   if (col > 0) {
+      draw_body(row,col-1);                                                      //  refresh tile to left
+      draw_lobe(row,col-1);
+   }
+
+   draw_body(row,col);                                                           //  refresh this tile
+   draw_lobe(row,col);
+
+   if (col < Ncols-1) draw_lobe(row,col+1);                                      //  refresh lobe from tile to right
+   return;
+}
+
+
+//  mark tile for redraw and queue window repaint for the area changed
+//  by draw_tile(row,col): tile and left neighbor, their lobes, lobe from
+//  right neighbor. GTK merges all queued areas and paints them once per frame.
+
+void damage_tile(int row, int col)
+{
+   int   ii = Tindex(row,col);
+   int   pw = int(0.2 * tileW + 0.5);
+   int   x1 = col * tileW - tileW - pw;
+   int   x2 = col * tileW + tileW;
+
+   if (! Tdirty[ii]) {
+      Tdirty[ii] = 1;
+      Ndirty++;
+   }
+
+   if (x1 < 0) x1 = 0;
+   if (dwin1) gtk_widget_queue_draw_area(dwin1,x1,row*tileH,x2-x1,tileH);
+   return;
+}
+
+
+//  mark all tiles for redraw and queue repaint of entire window
+
+void redraw_all()
+{
+   Tdirty.assign(Ntiles,1);
+   Ndirty = Ntiles;
+   if (dwin1) gtk_widget_queue_draw(dwin1);
+   return;
+}
+
+
+//  Pre-render every tile into the tile atlas. Each home tile gets a cell
+//  holding its protruding lobe (left) and its body with outline and recess
+//  hole (right), so draw_body() and draw_lobe() only blit from the atlas.
+//  Rebuilt by tile_window() when the tile size changes, by m_line() for
+//  a new line color.
+
+void build_atlas()
+{
+   cairo_t           *cr;
+   int               row1, col1, x0, y0, x1, y1;
+   int               px, py, pw, ph, cellW;
+   int64             seed;
+
+   free_atlas();
+
+   px = pw = int(0.2 * tileW + 0.5);                                             //  lobe width
+   ph = int(0.2 * tileH + 0.5);                                                  //  lobe height
+   cellW = pw + tileW;                                                           //  atlas cell = lobe + body
+
+   atlas = cairo_image_surface_create(CAIRO_FORMAT_RGB24,Ncols*cellW,Nrows*tileH);
+   cr = cairo_create(atlas);
+   cairo_set_line_width(cr,1);
+
+   for (row1 = 0; row1 < Nrows; row1++)                                          //  loop home positions
+   for (col1 = 0; col1 < Ncols; col1++)
+   {
+      x0 = col1 * cellW + pw;                                                    //  tile body position in atlas
+      y0 = row1 * tileH;
+      x1 = col1 * tileW;                                                         //  tile position in image
+      y1 = row1 * tileH;
+
+      cairo_save(cr);
+      cairo_rectangle(cr,x0,y0,tileW,tileH);                                     //  tile body
+      cairo_clip(cr);
+      cairo_set_source_surface(cr,wSurface,x0-x1,y0-y1);
+      cairo_paint(cr);
+
+      if (linecolor == 0) cairo_set_source_rgb(cr,1,1,1);                        //  tile outline
+      if (linecolor == 1) cairo_set_source_rgb(cr,0,0,0);
+      if (linecolor == 2) cairo_set_source_rgb(cr,1,0,0);
+      if (linecolor == 3) cairo_set_source_rgb(cr,0,1,0);
+      cairo_rectangle(cr,x0,y0,tileW,tileH);
+      cairo_stroke(cr);
+
+      if (col1 < Ncols-1) {                                                      //  recess hole where lobe from
+         seed = row1 + col1 + 1;                                                 //    right home tile fits in
+         py = int(drand(seed,0.6) * tileH + 0.1 * tileH);
+         cairo_set_source_rgb(cr,0,0,0);
+         cairo_rectangle(cr,x0+tileW-px,y0+py,pw,ph);
+         cairo_fill(cr);
+      }
+      cairo_restore(cr);
+
+      if (col1 == 0) continue;                                                   //  no lobe on left edge
+
+      seed = row1 + col1;                                                        //  lobe position
+      py = int(drand(seed,0.6) * tileH + 0.1 * tileH);
+
+      cairo_save(cr);
+      cairo_rectangle(cr,x0-px,y0+py,pw,ph);                                     //  protruding lobe
+      cairo_clip(cr);
+      cairo_set_source_surface(cr,wSurface,x0-x1,y0-y1);
+      cairo_paint(cr);
+
+      if (linecolor == 0) cairo_set_source_rgb(cr,1,1,1);                        //  lobe outline
+      if (linecolor == 1) cairo_set_source_rgb(cr,0,0,0);
+      if (linecolor == 2) cairo_set_source_rgb(cr,1,0,0);
+      if (linecolor == 3) cairo_set_source_rgb(cr,0,1,0);
+      cairo_move_to(cr,x0,y0+py);
+      cairo_line_to(cr,x0-px,y0+py);
+      cairo_line_to(cr,x0-px,y0+py+ph);
+      cairo_line_to(cr,x0,y0+py+ph);
+      cairo_stroke(cr);
+      cairo_restore(cr);
+   }
+
+   cairo_destroy(cr);
+
+   atlasPattern = cairo_pattern_create_for_surface(atlas);
+   atlasW = tileW;
+   atlasH = tileH;
+   return;
+}
+
+
+//  release tile atlas
+
+void free_atlas()
+{
+   if (atlasPattern) cairo_pattern_destroy(atlasPattern);
+   if (atlas) cairo_surface_destroy(atlas);
+   atlasPattern = 0;
+   atlas = 0;
+   return;
+}
+
+
+//  draw tile body at window position, with outline and recess hole
+
+void draw_body(int row2, int col2)
+{
+   int            ii, row1, col1, x0, y0, x2, y2, pw;
+   cairo_matrix_t matrix;
+
+   ii = pstate.hposn(Tindex(row2,col2));                                         //  tile home position
+   row1 = ii / Ncols;
+   col1 = ii % Ncols;
+
+   pw = int(0.2 * tileW + 0.5);
+   x0 = col1 * (pw + tileW) + pw;                                                //  position in atlas
+   y0 = row1 * tileH;
+   x2 = col2 * tileW;                                                            //  position in window
+   y2 = row2 * tileH;
+
+   cairo_matrix_init_translate(&matrix,x0-x2,y0-y2);                             //  map window to atlas
+   cairo_pattern_set_matrix(atlasPattern,&matrix);
+   cairo_set_source(bcr,atlasPattern);
+   cairo_rectangle(bcr,x2,y2,tileW,tileH);
+   cairo_fill(bcr);
+   return;
+}
+
+
+//  draw protruding lobe from left side of puzzle tile at window position
+
+void draw_lobe(int row2, int col2)
+{
+   int            ii, row1, col1, x0, y0, x2, y2, px, py, pw, ph;
+   int64          seed;
+   cairo_matrix_t matrix;
+
+   if (col2 == 0) return;                                                        //  window position on left edge
+
+   ii = pstate.hposn(Tindex(row2,col2));                                         //  get home position for tile
+   row1 = ii / Ncols;
+   col1 = ii % Ncols;
+   if (col1 == 0) return;                                                        //  home position on left edge
+
+   seed = row1 + col1;
+   px = pw = int(0.2 * tileW + 0.5);                                             //  get lobe position, size
+   py = int(drand(seed,0.6) * tileH + 0.1 * tileH);
+   ph = int(0.2 * tileH + 0.5);
+   x0 = col1 * (pw + tileW) + pw;                                                //  tile position in atlas
+   y0 = row1 * tileH;
+   x2 = col2 * tileW;                                                            //  tile position in window
+   y2 = row2 * tileH;
+
+   cairo_matrix_init_translate(&matrix,x0-x2,y0-y2);                             //  map window to atlas
+   cairo_pattern_set_matrix(atlasPattern,&matrix);
+   cairo_set_source(bcr,atlasPattern);
+   cairo_rectangle(bcr,x2-px,y2+py,pw,ph);
+   cairo_fill(bcr);
+   return;
+}
+
+
+//  update statistics on status bar
+
+void stbar_update()
+{
+   char     message[200];
+   int      cc;
+
+   if (! stbar) return;                                                          //  no GUI
+   cc = snprintf(message,200, ZTX("tiles home: %d/%d"),Nhome,Ntiles);             //  (cc = length if not truncated)
+   if (Ntiles && cc < 200) cc += snprintf(message+cc,200-cc,"  %s: %d  %s: %d",
+                                 ZTX("joined"),Njoined,ZTX("largest group"),Gmax);
+   if (Mstate > 1 && cc < 200) {
+      if (Gsel.size()) snprintf(message+cc,200-cc,"  %s: %d",
+                                 ZTX("group selected, tiles"),(int) Gsel.size());
+      else snprintf(message+cc,200-cc,"  %s",ZTX("1st tile selected"));
+   }
+   stbar_message(stbar,message);
+   return;
+}
+
+
+//  save current image directory upon exit, reload this upon startup             //  v.1.8
+//  directory is saved in file $HOME/.picpuz/image_directory
+
+void save_imagedirk()
+{
+   shell_ack("echo %s > %s/image_directory",imagedirk.c_str(), get_zuserdir());
+   return;
+}
+
+void load_imagedirk()
+{
+   int      err;
+   FILE     *fid;
+   STATB    statdat;
+   char     dirbuff[XFCC], *pp;
+
+   pp = getcwd(dirbuff,XFCC-1);                                                //  default is current directory
+   imagedirk = dirbuff;
+   
+   snprintf(dirbuff,XFCC-1,"%s/image_directory",get_zuserdir());                 //  read saved file
+   fid = fopen(dirbuff,"r");
+   if (! fid) return;
+   pp = fgets_trim(dirbuff,XFCC-1,fid,1);
+   fclose(fid);
+   if (! pp) return;
+   err = stat(dirbuff,&statdat);                                                 //  contains a valid directory name?
+   if (err) return;
+   if (! S_ISDIR(statdat.st_mode)) return;
+   imagedirk = dirbuff;                                                    //  yes, use it
+   return;
+}
+
+
+//  benchmarks for rendering hot paths, run from the command line without GUI
+//    picpuz -bench scale <imagefile>     zpixbuf_scale() vs gdk_pixbuf_scale_simple()
+//    picpuz -bench swap3 [cols] [rows]   tile cluster moves, worst case snake
+//    picpuz -bench mix [cols] [rows]     difficulty mix, targets and results
+//    picpuz -bench save [cols] [rows]    save file formats and encodings
+//    picpuz -bench fuzz [iter] [seed]    damaged save files are rejected or repaired
+//    picpuz -bench text                  text file reader vs former fscanf() reader
+
+int m_bench(int argc, char *argv[])
+{
+   void bench_board(int cols, int rows);
+   int bench_scale(cchar *file);
+   int bench_swap3(int cols, int rows);
+   int bench_mix(int cols, int rows);
+   int bench_save(int cols, int rows);
+   int bench_fuzz(int Niter, int seed);
+   int bench_text(void);
+
+   if (argc > 1 && strmatch(argv[0],"scale")) return bench_scale(argv[1]);
+   if (argc > 0 && strmatch(argv[0],"swap3"))
+      return bench_swap3(argc > 1 ? atoi(argv[1]) : 100, argc > 2 ? atoi(argv[2]) : 100);
+   if (argc > 0 && strmatch(argv[0],"mix"))
+      return bench_mix(argc > 1 ? atoi(argv[1]) : 400, argc > 2 ? atoi(argv[2]) : 250);
+   if (argc > 0 && strmatch(argv[0],"save"))
+      return bench_save(argc > 1 ? atoi(argv[1]) : 500, argc > 2 ? atoi(argv[2]) : 500);
+   if (argc > 0 && strmatch(argv[0],"fuzz"))
+      return bench_fuzz(argc > 1 ? atoi(argv[1]) : 10000, argc > 2 ? atoi(argv[2]) : 1);
+   if (argc > 0 && strmatch(argv[0],"text")) return bench_text();
+
+   printf("usage: picpuz -bench scale <imagefile> \n");
+   printf("       picpuz -bench swap3 [cols] [rows] \n");
+   printf("       picpuz -bench mix [cols] [rows] \n");
+   printf("       picpuz -bench save [cols] [rows] \n");
+   printf("       picpuz -bench fuzz [iterations] [seed] \n");
+   printf("       picpuz -bench text \n");
+   return 1;
+}
+
+
+//  solved board of cols x rows tiles for the benchmarks: model only,
+//  no image or window. The image file name goes into save files only.
+
+void bench_board(int cols, int rows)
+{
+   Ncols = cols;
+   Nrows = rows;
+   Ntiles = Nrows * Ncols;
+   tileW = tileH = 10;
+   imagefile = "/nonexistent/bench.jpg";
+   pstate.init(Ntiles);                                                          //  all tiles home
+   Tdirty.assign(Ntiles,0);
+   misplaced_init();                                                             //  Nhome = Ntiles
+   groups_init();
+   return;
+}
+
+
+//  rescale an image to several window sizes, best of 3 runs each
+
+int bench_scale(cchar *file)
+{
+   PIXBUF      *pxb1, *pxb2;
+   GError      *gerror = 0;
+   double      time0, secs[3];
+   int         ww, hh, ww2, hh2, ii, jj, kk;
+   int         div[4] = { 2, 4, 8, 0 };                                          //  0 = 1920 wide
+
+   pxb1 = gdk_pixbuf_new_from_file(file,&gerror);
+   if (! pxb1) {
+      printf("cannot read: %s \n",file);
+      return 1;
+   }
+
+   ww = gdk_pixbuf_get_width(pxb1);
+   hh = gdk_pixbuf_get_height(pxb1);
+   printf("image %dx%d  %.1f megapixels  %d cores \n",ww,hh,ww*hh*1e-6,get_Ncores());
+   printf("  output      gdk-pixbuf    box      lanczos   (secs) \n");
+
+   for (ii = 0; ii < 4; ii++)
+   {
+      if (div[ii]) {
+         ww2 = ww / div[ii];
+         hh2 = hh / div[ii];
+      }
+      else {
+         ww2 = 1920;
+         hh2 = 1920 * hh / ww;
+      }
+
+      for (jj = 0; jj < 3; jj++)                                                 //  gdk-pixbuf, box, Lanczos
+      {
+         secs[jj] = 999;
+         for (kk = 0; kk < 3; kk++)
+         {
+            start_timer(time0);
+            if (jj == 0) pxb2 = gdk_pixbuf_scale_simple(pxb1,ww2,hh2,interp);
+            else if (jj == 1) pxb2 = zpixbuf_scale(pxb1,ww2,hh2,ZSCALE_BOX);
+            else pxb2 = zpixbuf_scale(pxb1,ww2,hh2,ZSCALE_LANCZOS);
+            double tt = get_timer(time0);
+            if (tt < secs[jj]) secs[jj] = tt;
+            g_object_unref(pxb2);
+         }
+      }
+
+      printf("  %5dx%-5d  %8.4f  %8.4f  %8.4f \n",ww2,hh2,secs[0],secs[1],secs[2]);
+   }
+
+   g_object_unref(pxb1);
+   return 0;
+}
+
+
+//  Render a mixed puzzle board to a PNG file, without GUI or display.
+//  The board is composed by the same code as the window (tile atlas with
+//  lobes, holes and outlines), so the output can be compared to golden
+//  images. Timings of the rendering steps are printed.
+//    picpuz --render out.png [--tiles N] [--seed S] [--size WxH] imagefile
+
+int m_render(int argc, char *argv[])
+{
+   cchar       *pngfile = 0, *file = 0;
+   int         Nt = 100, ww = 1200, hh = 800, err;
+   int64       seed = 1;
+   double      time0, secs;
+   int         Nrep = 10;                                                        //  redraw repetitions
+
+   for (int ii = 0; ii < argc; ii++)
+   {
+      if (strmatch(argv[ii],"--render") && argc > ii+1) pngfile = argv[++ii];
+      else if (strmatch(argv[ii],"--tiles") && argc > ii+1) Nt = atoi(argv[++ii]);
+      else if (strmatch(argv[ii],"--seed") && argc > ii+1) seed = atoll(argv[++ii]);
+      else if (strmatch(argv[ii],"--size") && argc > ii+1) sscanf(argv[++ii],"%dx%d",&ww,&hh);
+      else file = argv[ii];
+   }
+
+   if (! pngfile || ! file || Nt < 1 || ww < 100 || hh < 100) {
+      printf("usage: picpuz --render out.png [--tiles N] [--seed S] [--size WxH] imagefile \n");
+      return 1;
+   }
+
+   allocW = ww;                                                                  //  board size
+   allocH = hh;
+   tileU = int(sqrt(1.0 * (ww-4) * (hh-4) / Nt) + 0.5);                          //  tile size for about N tiles
+   if (tileU < 10) tileU = 10;
+   imagefile = file;
+
+   start_timer(time0);
+   init_puzzle(1);                                                               //  load image, scale, tile atlas
+   if (! Ntiles) return 1;
+   secs = get_timer(time0);
+   printf("board %dx%d  tiles %dx%d = %d  tile %dx%d \n",winW,winH,Ncols,Nrows,Ntiles,tileW,tileH);
+   printf("load, scale, atlas:  %.4f secs \n",secs);
+
+   start_timer(time0);
+   for (int ii = 0; ii < Nrep; ii++) build_atlas();
+   printf("build atlas:         %.4f secs \n",get_timer(time0)/Nrep);
+
+   rseed = seed;                                                                 //  mix tiles, same seed = same board
+   mix_tiles();
+
+   start_timer(time0);
+   for (int ii = 0; ii < Nrep; ii++)                                             //  draw all tiles on board
+   for (int row = 0; row < Nrows; row++)
+   for (int col = 0; col < Ncols; col++)
+      draw_tile(row,col);
+   printf("draw all tiles:      %.4f secs \n",get_timer(time0)/Nrep);
+   Tdirty.assign(Ntiles,0);
+   Ndirty = 0;
+
+   start_timer(time0);
+   cairo_surface_flush(board);
+   err = cairo_surface_write_to_png(board,pngfile);
+   printf("write PNG file:      %.4f secs \n",get_timer(time0));
+   if (err) printf("cannot write %s: %s \n",pngfile,cairo_status_to_string((cairo_status_t) err));
+
+   clear_puzzle();
+   return err ? 1 : 0;
+}
+
+
+//  A snake shaped region (rows joined at alternate ends) in the top half
+//  of the board is exchanged with the same region in the bottom half.
+//  One click moves a tile of each region home, and swap3() moves both
+//  whole regions home. The clusters are long and thin, worst case for
+//  a search that scans the cluster for each tile added.
+
+int bench_swap3(int cols, int rows)
+{
+   void swap2(int, int, int, int);
+
+   vector<int>    snake;
+   double         time0, secs = 0;
+   int            row, col, drow, ii, Nrep = 10;
+
+   if (cols < 2 || rows < 4) return 1;
+
+   bench_board(cols,rows);
+
+   drow = Nrows / 2;
+   for (row = 0; row < drow; row++)                                              //  snake in top half
+   {
+      if (row % 2 == 0)
+         for (col = 0; col < Ncols; col++) snake.push_back(Tindex(row,col));
+      else if (row % 4 == 1) snake.push_back(Tindex(row,Ncols-1));
+      else snake.push_back(Tindex(row,0));
+   }
+
+   for (int rep = 0; rep < Nrep; rep++)
+   {
+      for (ii = 0; ii < (int) snake.size(); ii++) {                              //  exchange top and bottom snakes
+         row = snake[ii] / Ncols;
+         col = snake[ii] % Ncols;
+         swap2(row,col,row+drow,col);
+      }
+
+      start_timer(time0);
+      swap_tiles(0,0,drow,0);                                                    //  one click solves all
+      secs += get_timer(time0);
+
+      if (Nhome != Ntiles) {
+         printf("swap3 failed: %d of %d tiles home \n",Nhome,Ntiles);
+         return 1;
+      }
+   }
+
+   printf("board %dx%d  state %.1f MB  cluster %d tiles  %.3f millisecs per click \n",
+                  Ncols,Nrows,pstate.memory()/1e6,2 * (int) snake.size(),1000 * secs / Nrep);
+   return 0;
+}
+
+
+//  Tile edge compatibility, from the tile pixels only.
+//  Sides are 0/1/2/3 = top/right/bottom/left, side ^ 2 is the opposite side.
+//  For each tile side, the pixels along the edge and the pixels predicted
+//  just beyond it (2 * edge - next inner line, a gradient continued) are
+//  kept as byte strings. Tile2 fits on a side of tile1 if each tile's
+//  prediction matches the other tile's edge: the score is the sum of
+//  absolute differences both ways (zsad8, SSE2), lower is better. The K
+//  best partners of every tile side are found by scoring all tile pairs,
+//  the tiles split in bands over the CPU cores.
+
+int   edge_drow[4] = { -1, 0, 1, 0 }, edge_dcol[4] = { 0, 1, 0, -1 };           //  neighbor position per side
+
+struct edge_job_t {
+   edge_index_t   *ex;
+   int            Nt;                                                            //  thread count
+   volatile int   *stop;                                                         //  stop if *stop set
+};
+
+
+//  get edge and prediction bytes of all tiles from window image surf
+//  (home tile at row/col of the image, or tile names[posn] at image posn)
+
+void edge_features(edge_index_t &ex, cairo_surface_t *surf, int Nc, const int *names)
+{
+   int      posn, tile, side, kk, ch, L, x, y, x2, y2;
+
+   cairo_surface_flush(surf);
+   uint8 *pixels = cairo_image_surface_get_data(surf);
+   int stride = cairo_image_surface_get_stride(surf);
+
+   for (side = 0; side < 4; side++)
+   {
+      L = (side & 1) ? ex.th : ex.tw;                                            //  pixels along side
+      ex.Lcc[side] = (L * 4 + 15) / 16 * 16;                                     //  4 bytes, padded for SIMD
+      ex.edge[side].assign(ex.Nt * ex.Lcc[side],0);
+      ex.pred[side].assign(ex.Nt * ex.Lcc[side],0);
+
+      for (posn = 0; posn < ex.Nt; posn++)
+      for (kk = 0; kk < L; kk++)
+      {
+         tile = names ? names[posn] : posn;
+         x = posn % Nc * ex.tw;                                                  //  tile origin in image
+         y = posn / Nc * ex.th;
+         if (side == 0) { x += kk; x2 = x; y2 = y + 1; }                         //  edge pixel x,y
+         else if (side == 2) { x += kk; y += ex.th - 1; x2 = x; y2 = y - 1; }    //  next inner pixel x2,y2
+         else if (side == 3) { y += kk; x2 = x + 1; y2 = y; }
+         else { y += kk; x += ex.tw - 1; x2 = x - 1; y2 = y; }
+
+         uint8 *pix1 = pixels + y * stride + x * 4;
+         uint8 *pix2 = pixels + y2 * stride + x2 * 4;
+         uint8 *edge = &ex.edge[side][tile * ex.Lcc[side] + kk * 4];
+         uint8 *pred = &ex.pred[side][tile * ex.Lcc[side] + kk * 4];
+
+         for (ch = 0; ch < 3; ch++) {                                            //  color bytes (4th = 0)
+            int pp = 2 * pix1[ch] - pix2[ch];
+            if (pp < 0) pp = 0;
+            if (pp > 255) pp = 255;
+            edge[ch] = pix1[ch];
+            pred[ch] = pp;
+         }
+      }
+   }
+
+   return;
+}
+
+
+//  score of tile2 placed on given side of tile1
+
+uint32 edge_score(const edge_index_t &ex, int tile1, int side, int tile2)
+{
+   int      side2 = side ^ 2;
+   int      cc = ex.Lcc[side];
+
+   return zsad8(&ex.pred[side][tile1*cc],&ex.edge[side2][tile2*cc],cc)
+        + zsad8(&ex.pred[side2][tile2*cc],&ex.edge[side][tile1*cc],cc);
+}
+
+
+//  thread function: best partners for the sides of one band of tiles
+
+void edge_band(void *arg, int index)
+{
+   edge_job_t     *job = (edge_job_t *) arg;
+   edge_index_t   &ex = *job->ex;
+   int            tile1 = ex.Nt * index / job->Nt;
+   int            tile2 = ex.Nt * (index + 1) / job->Nt;
+   int            K = ex.K, side, tile, kk;
+   uint32         sc;
+
+   for ( ; tile1 < tile2; tile1++)
+   for (side = 0; side < 4; side++)
+   {
+      if (job->stop && *job->stop) return;
+
+      uint32 *score = &ex.score[(tile1 * 4 + side) * K];                         //  K best, ascending
+      int *partner = &ex.partner[(tile1 * 4 + side) * K];
+
+      for (kk = 0; kk < K; kk++) {
+         score[kk] = 0xffffffff;
+         partner[kk] = -1;
+      }
+
+      for (tile = 0; tile < ex.Nt; tile++)
+      {
+         if (tile == tile1) continue;
+         sc = edge_score(ex,tile1,side,tile);
+         if (sc >= score[K-1]) continue;
+         for (kk = K-1; kk > 0 && score[kk-1] > sc; kk--) {                      //  insert in order
+            score[kk] = score[kk-1];
+            partner[kk] = partner[kk-1];
+         }
+         score[kk] = sc;
+         partner[kk] = tile;
+      }
+   }
+
+   return;
+}
+
+
+//  build the edge index for Nr x Nc tiles of size tw x th in image surf,
+//  keeping the K best partners of each tile side (K >= 2)
+//  stop: optional, the build ends early (index not usable) if *stop is set
+//  names: optional, tile names[posn] is at image position posn (a test
+//    without the solved layout in the tile numbers), else tile = posn
+
+void edge_index_build(edge_index_t &ex, cairo_surface_t *surf, int Nr, int Nc, int tw, int th,
+                      int K, volatile int *stop, const int *names)
+{
+   edge_job_t     job;
+
+   ex.Nt = Nr * Nc;
+   ex.K = K;
+   ex.tw = tw;
+   ex.th = th;
+   edge_features(ex,surf,Nc,names);
+
+   ex.score.resize(ex.Nt * 4 * K);
+   ex.partner.resize(ex.Nt * 4 * K);
+
+   job.ex = &ex;
+   job.stop = stop;
+   job.Nt = get_Ncores();                                                        //  at least 16 tiles per band
+   if (job.Nt > ex.Nt / 16) job.Nt = ex.Nt / 16;
+   if (job.Nt < 1) job.Nt = 1;
+   do_wthreads(edge_band,&job,job.Nt);
+   return;
+}
+
+
+//  Arrange the tiles on a board of Nr x Nc positions using the edge index.
+//  Tile numbers are only names here, the solution comes from the pixels.
+//  place[posn] = tile at window position posn (Nr x Nc).
+//
+//  1. Candidate pairs from the best partner lists are ranked by score
+//     divided by the best alternative of either tile (a pair that is
+//     clearly better than the alternatives first, like best buddies).
+//  2. In this order, pairs join tiles into rigid segments, unless the
+//     segments would overlap or not fit in Nr x Nc.
+//  3. The largest segment is placed at the top left, then the other
+//     segments (2+ tiles) where they fit best against placed tiles.
+//     Offsets are voted by the placed best partners of the segment
+//     tiles, and the top voted offsets are scored: O(segment x K).
+//     Only a segment without a fitting partner tries all offsets.
+//  4. The remaining holes are filled one at a time, the hole with most
+//     placed neighbors first, with the best matching remaining tile.
+
+void solve_tiles(const edge_index_t &ex, int Nr, int Nc, int *place)
+{
+   struct cand_t { float wt; int tile1, side, tile2; };
+   struct seg_t { vector<int> tiles; int r1, r2, c1, c2; };
+
+   int      N = ex.Nt, K = ex.K;
+   int      tile, side, kk, ii, posn;
+
+   auto second = [&](int tile, int side, int not_tile) -> uint32 {               //  best score not with not_tile
+      const int *partner = &ex.partner[(tile * 4 + side) * K];
+      const uint32 *score = &ex.score[(tile * 4 + side) * K];
+      return (partner[0] != not_tile) ? score[0] : score[1];
+   };
+
+   vector<cand_t> cands;                                                         //  1. candidate pairs,
+   cands.reserve(N * 4 * K);                                                     //     tile2 right or below tile1
+   for (tile = 0; tile < N; tile++)
+   for (side = 0; side < 4; side++)
+   for (kk = 0; kk < K; kk++)
+   {
+      int tile2 = ex.partner[(tile * 4 + side) * K + kk];
+      if (tile2 < 0) break;
+      cand_t cc;
+      if (side == 1 || side == 2) { cc.tile1 = tile; cc.side = side; cc.tile2 = tile2; }
+      else { cc.tile1 = tile2; cc.side = side ^ 2; cc.tile2 = tile; }
+      uint32 alt = second(cc.tile1,cc.side,cc.tile2);
+      uint32 alt2 = second(cc.tile2,cc.side ^ 2,cc.tile1);
+      if (alt2 < alt) alt = alt2;
+      cc.wt = (ex.score[(tile * 4 + side) * K + kk] + 1.0) / (alt + 1.0);
+      cands.push_back(cc);
+   }
+
+   std::sort(cands.begin(),cands.end(),[](const cand_t &a, const cand_t &b) { return a.wt < b.wt; });
+
+   vector<int>    seg(N), prow(N), pcol(N);                                      //  2. segments: segment of tile,
+   vector<seg_t>  segs(N);                                                       //     row/col in segment
+   std::unordered_set<uint64>  occupied;                                         //  segment, row, col in use
+
+   auto key = [](int sg, int row, int col) -> uint64 {
+      return (uint64) sg << 42 | (uint64) (row + (1 << 20)) << 21 | (col + (1 << 20));
+   };
+
+   for (tile = 0; tile < N; tile++) {                                            //  each tile is a segment
+      seg[tile] = tile;
+      prow[tile] = pcol[tile] = 0;
+      segs[tile].tiles.push_back(tile);
+      segs[tile].r1 = segs[tile].r2 = segs[tile].c1 = segs[tile].c2 = 0;
+      occupied.insert(key(tile,0,0));
+   }
+
+   for (ii = 0; ii < (int) cands.size(); ii++)
+   {
+      int fix = cands[ii].tile1, mov = cands[ii].tile2;                          //  mov goes beside fix
+      int dr = edge_drow[cands[ii].side], dc = edge_dcol[cands[ii].side];
+      if (seg[fix] == seg[mov]) continue;
+      if (segs[seg[fix]].tiles.size() < segs[seg[mov]].tiles.size()) {          //  move the smaller segment
+         std::swap(fix,mov);
+         dr = -dr;
+         dc = -dc;
+      }
+
+      seg_t &A = segs[seg[fix]], &B = segs[seg[mov]];
+      int sa = seg[fix], sb = seg[mov];
+      int orow = prow[fix] + dr - prow[mov];                                     //  B offset in A
+      int ocol = pcol[fix] + dc - pcol[mov];
+
+      int r1 = std::min(A.r1,B.r1+orow), r2 = std::max(A.r2,B.r2+orow);
+      int c1 = std::min(A.c1,B.c1+ocol), c2 = std::max(A.c2,B.c2+ocol);
+      if (r2 - r1 >= Nr || c2 - c1 >= Nc) continue;                              //  does not fit on board
+
+      for (kk = 0; kk < (int) B.tiles.size(); kk++) {                            //  overlap
+         tile = B.tiles[kk];
+         if (occupied.count(key(sa,prow[tile]+orow,pcol[tile]+ocol))) break;
+      }
+      if (kk < (int) B.tiles.size()) continue;
+
+      for (int tile : B.tiles) {                                                 //  join B to A
+         occupied.erase(key(sb,prow[tile],pcol[tile]));
+         prow[tile] += orow;
+         pcol[tile] += ocol;
+         seg[tile] = sa;
+         occupied.insert(key(sa,prow[tile],pcol[tile]));
+         A.tiles.push_back(tile);
+      }
+
+      A.r1 = r1; A.r2 = r2; A.c1 = c1; A.c2 = c2;
+      B.tiles.clear();
+   }
+
+   vector<int>    order;                                                         //  3. place segments,
+   for (ii = 0; ii < N; ii++)                                                    //     largest first
+      if (segs[ii].tiles.size()) order.push_back(ii);
+   std::sort(order.begin(),order.end(),[&](int a, int b) {
+      return segs[a].tiles.size() > segs[b].tiles.size(); });
+
+   vector<int>    singles;                                                       //  tiles left for step 4
+   vector<uint8>  used(N,0);                                                     //  tile is placed
+   vector<int>    where(N,-1);                                                   //  position of placed tile
+   std::unordered_map<uint64,int>      votes;                                    //  segment offset, votes
+   vector<std::pair<int,uint64>>       offsets;                                  //  votes, offset
+   for (posn = 0; posn < N; posn++) place[posn] = -1;
+
+   for (ii = 0; ii < (int) order.size(); ii++)
+   {
+      seg_t &S = segs[order[ii]];
+      int bestR = 0, bestC = 0, found = 0;
+      double best = 0;
+
+      if (S.tiles.size() == 1) {
+         singles.push_back(S.tiles[0]);
+         continue;
+      }
+
+      if (ii == 0) {                                                             //  largest at top left
+         bestR = -S.r1;
+         bestC = -S.c1;
+         found = 1;
+      }
+
+      votes.clear();                                                             //  offsets that put a tile
+      for (int tile : S.tiles)                                                   //    beside a placed partner
+      for (side = 0; side < 4; side++)
+      for (kk = 0; kk < K; kk++)
+      {
+         int tile2 = ex.partner[(tile * 4 + side) * K + kk];
+         if (tile2 < 0 || where[tile2] < 0) continue;
+         int orow = where[tile2] / Nc - edge_drow[side] - prow[tile];
+         int ocol = where[tile2] % Nc - edge_dcol[side] - pcol[tile];
+         if (orow < -S.r1 || orow + S.r2 >= Nr || ocol < -S.c1 || ocol + S.c2 >= Nc) continue;
+         votes[key(0,orow,ocol)] += K - kk;                                      //  better partner, more votes
+      }
+
+      auto try_offset = [&](int orow, int ocol) {                                //  mean score against placed
+         double sum = 0;                                                         //    neighbors, keep best
+         int Npair = 0;
+         for (int tile : S.tiles)
+         {
+            int row = prow[tile] + orow, col = pcol[tile] + ocol;
+            if (place[row * Nc + col] >= 0) return;                              //  position in use
+            for (int side = 0; side < 4; side++) {
+               int row2 = row + edge_drow[side], col2 = col + edge_dcol[side];
+               if (row2 < 0 || row2 >= Nr || col2 < 0 || col2 >= Nc) continue;
+               int tile2 = place[row2 * Nc + col2];
+               if (tile2 < 0) continue;
+               sum += edge_score(ex,tile,side,tile2);
+               Npair++;
+            }
+         }
+         if (! Npair) return;
+         if (! found || sum / Npair < best) {
+            best = sum / Npair;
+            bestR = orow;
+            bestC = ocol;
+            found = 1;
+         }
+      };
+
+      offsets.clear();                                                           //  top voted offsets
+      for (auto &it : votes) offsets.push_back(std::make_pair(-it.second,it.first));
+      int Ntry = std::min((int) offsets.size(),8);
+      std::partial_sort(offsets.begin(),offsets.begin()+Ntry,offsets.end());
+      for (int tt = 0; tt < Ntry; tt++)
+         try_offset((offsets[tt].second >> 21 & 0x1fffff) - (1 << 20),          //  unpack key()
+                     (offsets[tt].second & 0x1fffff) - (1 << 20));
+
+      if (! found)                                                               //  no placed partner fits:
+         for (int orow = -S.r1; orow + S.r2 < Nr; orow++)                        //    try all offsets on board
+         for (int ocol = -S.c1; ocol + S.c2 < Nc; ocol++)
+            try_offset(orow,ocol);
+
+      if (! found) {                                                             //  no fit, dissolve segment
+         for (int tile : S.tiles) singles.push_back(tile);
+         continue;
+      }
+
+      for (int tile : S.tiles) {
+         posn = (prow[tile] + bestR) * Nc + pcol[tile] + bestC;
+         place[posn] = tile;
+         where[tile] = posn;
+         used[tile] = 1;
+      }
+   }
+
+   vector<int>    holes;                                                         //  4. fill holes
+   for (posn = 0; posn < N; posn++)
+      if (place[posn] < 0) holes.push_back(posn);
+
+   while (holes.size())
+   {
+      int hbest = 0, nbest = -1;
+      for (ii = 0; ii < (int) holes.size(); ii++) {                              //  hole with most neighbors
+         int nn = 0;
+         for (side = 0; side < 4; side++) {
+            int row2 = holes[ii] / Nc + edge_drow[side], col2 = holes[ii] % Nc + edge_dcol[side];
+            if (row2 >= 0 && row2 < Nr && col2 >= 0 && col2 < Nc && place[row2 * Nc + col2] >= 0) nn++;
+         }
+         if (nn > nbest) { nbest = nn; hbest = ii; }
+      }
+
+      posn = holes[hbest];
+      holes[hbest] = holes.back();
+      holes.pop_back();
+
+      vector<int> cands2;                                                        //  partners of the neighbors,
+      for (side = 0; side < 4; side++) {                                         //    else all remaining tiles
+         int row2 = posn / Nc + edge_drow[side], col2 = posn % Nc + edge_dcol[side];
+         if (row2 < 0 || row2 >= Nr || col2 < 0 || col2 >= Nc) continue;
+         int tile2 = place[row2 * Nc + col2];
+         if (tile2 < 0) continue;
+         for (kk = 0; kk < K; kk++) {
+            tile = ex.partner[(tile2 * 4 + (side ^ 2)) * K + kk];
+            if (tile >= 0 && ! used[tile]) cands2.push_back(tile);
+         }
+      }
+
+      int best = -1;
+      double bestsc = 0;
+      for (int pass = 0; pass < 2 && best < 0; pass++)
+      {
+         vector<int> &tiles = pass ? singles : cands2;
+         for (int tile : tiles)
+         {
+            if (used[tile]) continue;
+            double sum = 0;
+            int Npair = 0;
+            for (side = 0; side < 4; side++) {
+               int row2 = posn / Nc + edge_drow[side], col2 = posn % Nc + edge_dcol[side];
+               if (row2 < 0 || row2 >= Nr || col2 < 0 || col2 >= Nc) continue;
+               int tile2 = place[row2 * Nc + col2];
+               if (tile2 < 0) continue;
+               sum += edge_score(ex,tile,side,tile2);
+               Npair++;
+            }
+            if (Npair) sum /= Npair;
+            if (best < 0 || sum < bestsc) {
+               best = tile;
+               bestsc = sum;
+            }
+         }
+      }
+
+      place[posn] = best;
+      used[best] = 1;
+   }
+
+   return;
+}
+
+
+//  Edge index of the current puzzle, for move hints. It is built by a
+//  thread from the high quality window image after tile_window(), and is
+//  kept until the tile size or the image changes. A build made obsolete
+//  by a later one is stopped and its result discarded.
+
+void edge_index_start()
+{
+   void * hint_thread(void *);
+
+   if (! dwin1 || ! wSurface || ! Ntiles) return;                                //  no GUI, no puzzle
+
+   if (Eindex.Nt == Ntiles && Eindex.tw == tileW && Eindex.th == tileH)          //  current index still good
+      return;
+
+   if (Hjob && Hjob->Nr == Nrows && Hjob->Nc == Ncols                            //  build in progress
+            && Hjob->tw == tileW && Hjob->th == tileH) return;
+
+   if (Hjob) Hjob->stop = 1;                                                     //  stop obsolete build
+   Eindex = edge_index_t();
+
+   Hjob = new hint_job_t;
+   Hjob->surf = cairo_surface_reference(wSurface);                               //  keep image while in use
+   Hjob->Nr = Nrows;
+   Hjob->Nc = Ncols;
+   Hjob->tw = tileW;
+   Hjob->th = tileH;
+   Hjob->stop = 0;
+   start_detached_thread(hint_thread,Hjob);
+   return;
+}
+
+
+//  thread function: build edge index, hand over in main thread
+
+void * hint_thread(void *arg)
+{
+   int hint_done(void *);
+
+   hint_job_t *job = (hint_job_t *) arg;
+   edge_index_build(job->ex,job->surf,job->Nr,job->Nc,job->tw,job->th,edgeK,&job->stop);
+   g_idle_add(hint_done,job);
+   return 0;
+}
+
+
+int hint_done(void *arg)
+{
+   hint_job_t *job = (hint_job_t *) arg;
+
+   if (job == Hjob && ! job->stop) {                                             //  not obsolete
+      std::swap(Eindex,job->ex);
+      Hjob = 0;
+   }
+
+   cairo_surface_destroy(job->surf);
+   delete job;
+   return 0;
+}
+
+
+void edge_index_free()
+{
+   if (Hjob) Hjob->stop = 1;                                                     //  thread deletes job
+   Hjob = 0;
+   Eindex = edge_index_t();
+   hint_show(-1,-1);
+   return;
+}
+
+
+//  Find a swap that puts a misplaced tile's best matching tile next to it.
+//  For each side of each misplaced tile m, the tile a on that side has a
+//  list of best partners from the edge index. If the top partner c fits
+//  better than m, moving c to the position of m is a candidate. Best
+//  buddies (a is also c's top partner) come first, then the largest
+//  improvement. Tiles that are already beside their best buddy stay put.
+//  Cost: misplaced tiles x 4 x K lookups, no tile pairs are scored. The
+//  search ends after 256 misplaced tiles if a best buddy was found.
+//  returns 0 if no index or no candidate, else c at posn1, m at posn2
+
+int hint_swap(int &posn1, int &posn2)
+{
+   int      K = Eindex.K, side, kk, ii, buddy, best_buddy = 0;
+   double   best = 2;
+
+   if (Eindex.Nt != Ntiles || Eindex.tw != tileW || Eindex.th != tileH) return 0;
+
+   auto top = [&](int tile, int side) -> int {                                   //  top partner of tile side
+      return Eindex.partner[(tile * 4 + side) * K];
+   };
+
+   posn1 = posn2 = -1;
+
+   for (ii = 0; ii < (int) Mtiles.size(); ii++)
+   {
+      if (best_buddy && ii >= 256) break;                                        //  good enough
+
+      int mtile = Mtiles[ii];
+      int mposn = pstate.wposn(mtile);
+      int mrow = mposn / Ncols, mcol = mposn % Ncols;
+
+      for (side = 0; side < 4; side++)
+      {
+         int row = mrow + edge_drow[side], col = mcol + edge_dcol[side];
+         if (row < 0 || row >= Nrows || col < 0 || col >= Ncols) continue;
+         int atile = pstate.hposn(Tindex(row,col));                              //  neighbor tile a,
+         int aside = side ^ 2;                                                   //    m is on this side of a
+         const int *partner = &Eindex.partner[(atile * 4 + aside) * K];
+         const uint32 *score = &Eindex.score[(atile * 4 + aside) * K];
+
+         int ctile = partner[0];
+         if (ctile < 0 || ctile == mtile) continue;                              //  m is the best fit
+
+         uint32 mscore = score[K-1];                                             //  score of m, at least
+         for (kk = 0; kk < K; kk++)                                              //    the worst of K best
+            if (partner[kk] == mtile) mscore = score[kk];
+
+         double ratio = (score[0] + 1.0) / (mscore + 1.0);                       //  < 1: c fits better
+         buddy = (top(ctile,side) == atile);
+         if (buddy < best_buddy) continue;
+         if (buddy == best_buddy && ratio >= best) continue;
+
+         int cposn = pstate.wposn(ctile);                                        //  c beside its best buddy
+         int crow = cposn / Ncols, ccol = cposn % Ncols;
+         for (kk = 0; kk < 4; kk++) {
+            int row2 = crow + edge_drow[kk], col2 = ccol + edge_dcol[kk];
+            if (row2 < 0 || row2 >= Nrows || col2 < 0 || col2 >= Ncols) continue;
+            int ntile = pstate.hposn(Tindex(row2,col2));
+            if (top(ctile,kk) == ntile && top(ntile,kk ^ 2) == ctile) break;
+         }
+         if (kk < 4) continue;
+
+         best_buddy = buddy;
+         best = ratio;
+         posn1 = cposn;
+         posn2 = mposn;
+      }
+   }
+
+   return (posn1 >= 0);
+}
+
+
+//  outline two tiles as a move hint, or remove the outline (-1, -1)
+
+void hint_show(int posn1, int posn2)
+{
+   int      posns[4] = { hintP1, hintP2, posn1, posn2 };
+
+   hintP1 = posn1;
+   hintP2 = posn2;
+   if (! dwin1) return;
+
+   for (int ii = 0; ii < 4; ii++)
+      if (posns[ii] >= 0)
+         gtk_widget_queue_draw_area(dwin1,posns[ii] % Ncols * tileW,posns[ii] / Ncols * tileH,tileW,tileH);
+   return;
+}
+
+
+//  suggest a move: outline the tile to move and where it goes
+
+void m_hint()
+{
+   int      posn1, posn2;
+
+   if (! Ntiles) return;
+   anim_finish();
+
+   if (Hjob || Eindex.Nt != Ntiles) {
+      stbar_message(stbar,ZTX("hint: still comparing tiles, try again"));
+      return;
+   }
+
+   if (! hint_swap(posn1,posn2)) {
+      stbar_message(stbar,ZTX("hint: no suggestion"));
+      return;
+   }
+
+   hint_show(posn1,posn2);
+   return;
+}
+
+
+//  Solve a puzzle from the tile pixels only, without GUI or display, and
+//  report the accuracy and time used. Direct: tiles at the right position.
+//  Neighbors: adjacent tile pairs that are right (a solution shifted by
+//  one position is still mostly right). The tiles get random names, so
+//  that ties in the solver (tile order) do not favor the solved layout.
+//    picpuz --solve [--tile N] [--size WxH] [--seed N] imagefile
+
+int m_solve(int argc, char *argv[])
+{
+   edge_index_t   ex;
+   vector<int>    place, names, home;
+   cchar          *file = 0;
+   int            ww = 1200, hh = 800, tile = 40, seed = 1;
+   int            posn, Ndirect = 0, Nnbr = 0, Nadj;
+   double         time0, secs1, secs2;
+
+   for (int ii = 1; ii < argc; ii++)
+   {
+      if (strmatch(argv[ii],"--tile") && argc > ii+1) tile = atoi(argv[++ii]);
+      else if (strmatch(argv[ii],"--size") && argc > ii+1) sscanf(argv[++ii],"%dx%d",&ww,&hh);
+      else if (strmatch(argv[ii],"--seed") && argc > ii+1) seed = atoi(argv[++ii]);
+      else file = argv[ii];
+   }
+
+   if (! file || tile < 4 || ww < 100 || hh < 100) {
+      printf("usage: picpuz --solve [--tile N] [--size WxH] [--seed N] imagefile \n");
+      return 1;
+   }
+
+   allocW = ww;                                                                  //  board size
+   allocH = hh;
+   tileU = tile;
+   imagefile = file;
+
+   init_puzzle(1);                                                               //  load image, scale
+   if (! Ntiles) return 1;
+   printf("board %dx%d  tiles %dx%d = %d  tile %dx%d  %d cores \n",
+                  winW,winH,Ncols,Nrows,Ntiles,tileW,tileH,get_Ncores());
+
+   names.resize(Ntiles);                                                         //  names[posn] = tile at image posn
+   home.resize(Ntiles);                                                          //  home[tile] = image posn of tile
+   rseed = seed;
+   for (posn = 0; posn < Ntiles; posn++) names[posn] = posn;
+   for (posn = Ntiles - 1; posn > 0; posn--)
+      std::swap(names[posn],names[lrand(rseed,posn+1)]);
+   for (posn = 0; posn < Ntiles; posn++) home[names[posn]] = posn;
+
+   start_timer(time0);
+   edge_index_build(ex,wSurface,Nrows,Ncols,tileW,tileH,edgeK,0,&names[0]);
+   secs1 = get_timer(time0);
+
+   start_timer(time0);
+   place.resize(Ntiles);
+   solve_tiles(ex,Nrows,Ncols,&place[0]);
+   secs2 = get_timer(time0);
+
+   for (posn = 0; posn < Ntiles; posn++)                                         //  home of placed tile
+   {
+      int home1 = home[place[posn]];
+      if (home1 == posn) Ndirect++;
+      if (posn % Ncols < Ncols-1 && home[place[posn+1]] == home1+1
+                                 && home1 % Ncols < Ncols-1) Nnbr++;
+      if (posn + Ncols < Ntiles && home[place[posn+Ncols]] == home1+Ncols) Nnbr++;
+   }
+   Nadj = Nrows * (Ncols-1) + (Nrows-1) * Ncols;
+
+   printf("edge scores:  %.4f secs \n",secs1);
+   printf("placement:    %.4f secs \n",secs2);
+   printf("accuracy:     direct %.1f %%  neighbors %.1f %% \n",
+                  100.0 * Ndirect / Ntiles,Nadj ? 100.0 * Nnbr / Nadj : 100.0);
+
+   clear_puzzle();
+   return 0;
+}
+
+
+//  mix a board to several difficulty targets, print time and result
+
+int bench_mix(int cols, int rows)
+{
+   double      targets[6][3] = { { 30, 2, 30 }, { 60, 4, 10 }, { 100, 10, 0 },       //  misplaced %, distance,
+                                 { 10, 1, 0 }, { 100, 50, 50 }, { 50, 20, 100 } };  //    joined pairs %
+   double      time0, secs, dist;
+   int         Nmis, Njoin, ii;
+
+   if (cols < 2 || rows < 2) return 1;
+
+   rseed = 1;
+   printf("board %dx%d = %d tiles \n",cols,rows,cols * rows);
+   printf("   target: misplaced  distance  joined    result: misplaced  distance  joined    secs \n");
+
+   for (ii = 0; ii < 6; ii++)
+   {
+      bench_board(cols,rows);                                                    //  solved board
+      double *tt = targets[ii];
+      int Nmis1 = int(Ntiles * tt[0] / 100);
+      int Njoin1 = int(Nmis1 * tt[2] / 200);
+
+      start_timer(time0);
+      mix_tiles_target(Nmis1,tt[1],Njoin1);
+      secs = get_timer(time0);
+
+      mix_stats(Nmis,dist,Njoin);
+      printf("   %16d  %8.1f  %6d  %16d  %8.2f  %6d  %6.3f \n",
+                     Nmis1,tt[1],Njoin1,Nmis,dist,Njoin,secs);
+   }
+
+   return 0;
+}
+
+//  write the current puzzle in the older text format, as written by
+//  older picpuz, for benchmarks. returns 0 = OK.
+
+int bench_write_text(cchar *file)
+{
+   FILE *fid = fopen(file,"w");
+   if (! fid) return 1;
+   fprintf(fid,"%s \n",imagefile.c_str());
+   fprintf(fid," %d %d \n",Ntiles,Nhome);
+   fprintf(fid," %d %d \n",Nrows,Ncols);
+   for (int row = 0; row < Nrows; row++) {
+      for (int col = 0; col < Ncols; col++) {
+         int posn = pstate.wposn(Tindex(row,col));
+         fprintf(fid," %d,%d ",posn / Ncols, posn % Ncols);
+      }
+      fprintf(fid,"\n");
+   }
+   return fclose(fid) ? 1 : 0;
+}
+
+
+//  former text file reader, fscanf() per tile, as baseline for bench_text()
+//  returns 0 = OK, 1 = cannot open, 2 = not valid
+
+int bench_read_fscanf(cchar *file, string &image)
+{
+   char        buff[XFCC];
+   int         row2, col2, stat = 0;
+
+   FILE *fid = fopen(file,"r");
+   if (! fid) return 1;
+
+   if (! fgets_trim(buff,XFCC,fid,1)) stat = 2;                                  //  read image file name
+   else image = buff;
+   if (! stat && fscanf(fid," %d %d ",&Ntiles,&Nhome) != 2) stat = 2;
+   if (! stat && fscanf(fid," %d %d ",&Nrows,&Ncols) != 2) stat = 2;
+   if (! stat && (Nrows < 1 || Ncols < 1 || (int64) Nrows * Ncols != Ntiles)) stat = 2;
+
+   if (! stat) pstate.init(Ntiles);
+
+   for (int row1 = 0; row1 < Nrows && ! stat; row1++) {                          //  read tile position data
+      for (int col1 = 0; col1 < Ncols && ! stat; col1++) {
+         if (fscanf(fid," %d,%d ",&row2,&col2) != 2) stat = 2;
+         else if (row2 < 0 || row2 >= Nrows || col2 < 0 || col2 >= Ncols) stat = 2;
+         else pstate.set_wposn(Tindex(row1,col1),Tindex(row2,col2));
+      }
+   }
+
+   fclose(fid);
+   return stat;
+}
+
+
+//  save and resume a mixed board, binary and older text format:
+//  file size, write and read time, tile positions read back the same
+
+int bench_save(int cols, int rows)
+{
+   string      image, file1, file2;
+   uint64      ihash;
+   double      time0, secs[4];
+   int         err[2], bad = 0, Nfix;
+
+   if (cols < 2 || rows < 2) return 1;
+
+   rseed = 1;
+   bench_board(cols,rows);                                                       //  mixed board
+   printf("board %dx%d = %d tiles \n",Ncols,Nrows,Ntiles);
+   mix_tiles();
+   vector<uint32> posn0(Ntiles);
+   for (int ii = 0; ii < Ntiles; ii++) posn0[ii] = pstate.wposn(ii);
+
+   file1 = "/tmp/picpuz-bench.puz";
+   file2 = "/tmp/picpuz-bench.txt";
+
+   start_timer(time0);                                                           //  binary format
+   err[0] = puzzle_write(file1.c_str());
+   secs[0] = get_timer(time0);
+
+   start_timer(time0);                                                           //  text format
+   err[1] = bench_write_text(file2.c_str());
+   secs[1] = get_timer(time0);
+
+   for (int kk = 0; kk < 2; kk++)                                                //  read back both
+   {
+      pstate.init(1);
+      Ntiles = Nrows = Ncols = 0;
+      start_timer(time0);
+      err[kk] |= puzzle_read(kk ? file2.c_str() : file1.c_str(),image,ihash,Nfix);
+      if (Nfix) bad++;
+      secs[kk+2] = get_timer(time0);
+      if (Ntiles != cols * rows || image != imagefile) bad++;
+      else for (int ii = 0; ii < Ntiles; ii++)
+         if (pstate.wposn(ii) != (int) posn0[ii]) bad++;
+   }
+
+   struct stat sb1, sb2;
+   stat(file1.c_str(),&sb1);
+   stat(file2.c_str(),&sb2);
+   printf("   format     bytes       write    read (secs) \n");
+   printf("   binary  %10lld  %8.4f  %8.4f \n",(int64) sb1.st_size,secs[0],secs[2]);
+   printf("   text    %10lld  %8.4f  %8.4f \n",(int64) sb2.st_size,secs[1],secs[3]);
+   printf("   status %d %d  mismatches %d \n",err[0],err[1],bad);
+
+   double   fracs[4] = { 0.001, 0.01, 0.1, 1.0 };                                //  encodings, near solved to mixed
+   cchar    *packs[3] = { "flat", "sparse", "deflate" };
+   vector<uint8>  buff;
+
+   printf("   misplaced  encoding      bytes    encode    read (secs) \n");
+
+   for (int ff = 0; ff < 4; ff++)
+   {
+      bench_board(cols,rows);
+      mix_tiles_target(int(fracs[ff] * Ntiles),4,0);
+      for (int ii = 0; ii < Ntiles; ii++) posn0[ii] = pstate.wposn(ii);
+      int Nmis = Mtiles.size();
+
+      for (int pack = 0; pack < 3; pack++)                                       //  encodings used if smaller
+      {
+         start_timer(time0);
+         puzzle_encode(buff,0,pack);
+         secs[0] = get_timer(time0);
+         err[0] = zwrite_atomic(file1.c_str(),&buff[0],buff.size());
+
+         pstate.init(1);
+         Ntiles = Nrows = Ncols = 0;
+         start_timer(time0);
+         err[0] |= puzzle_read(file1.c_str(),image,ihash,Nfix);
+         secs[1] = get_timer(time0);
+         if (err[0] || Nfix || Ntiles != cols * rows) bad++;
+         else for (int ii = 0; ii < Ntiles; ii++)
+            if (pstate.wposn(ii) != (int) posn0[ii]) bad++;
+
+         int enc = le32(((puz_header_t *) &buff[0])->encoding);
+         printf("   %9d  %-8s  %9d  %8.4f  %8.4f \n",Nmis,packs[enc],(int) buff.size(),secs[0],secs[1]);
+      }
+   }
+
+   printf("   mismatches %d \n",bad);
+   remove(file1.c_str());
+   remove(file2.c_str());
+   return (err[0] || err[1] || bad);
+}
+
+
+//  Loader fuzz test: save files of small random boards are damaged at
+//  random and read back. Binary files get a valid checksum afterwards
+//  for half of the tests, else nearly all would fail the checksum test
+//  and the later checks would not be reached. Every read must fail or
+//  give a permutation of Nrows * Ncols tiles. Build with
+//  -fsanitize=address to also find invalid memory accesses.
+
+int bench_fuzz(int Niter, int seed)
+{
+   string         image, file = "/tmp/picpuz-fuzz.puz";
+   vector<uint8>  buff;
+   vector<uint64> used;
+   uint64         ihash;
+   char           text[40];
+   int            Nfix, stat, kk, nn, Nok = 0, Nfixed = 0, Nbad = 0, Nerr = 0;
+
+   rseed = seed;
+
+   for (int iter = 0; iter < Niter; iter++)
+   {
+      nn = 1 + lrand(rseed,12);                                                  //  random board
+      bench_board(nn,1 + lrand(rseed,12));
+      for (kk = lrand(rseed,Ntiles+1); kk > 0; kk--)                             //  some or all tiles mixed
+         pstate.swap(lrand(rseed,Ntiles),lrand(rseed,Ntiles));
+      misplaced_init();
+      groups_init();
+
+      int binary = iter & 1;
+      if (binary) puzzle_encode(buff,0,lrand(rseed,3));                          //  flat, sparse, or deflate
+      else {                                                                     //  text format
+         string ss = imagefile + " \n";
+         snprintf(text,40," %d %d \n %d %d \n",Ntiles,Nhome,Nrows,Ncols);
+         ss += text;
+         for (kk = 0; kk < Ntiles; kk++) {
+            int posn = pstate.wposn(kk);
+            snprintf(text,40," %d,%d ",posn / Ncols,posn % Ncols);
+            ss += text;
+         }
+         buff.assign(ss.begin(),ss.end());
+      }
+
+      nn = 1 + lrand(rseed,4);                                                   //  1-4 kinds of damage
+      while (nn--)
+      {
+         int size = buff.size();
+         if (! size) break;
+         int pos = lrand(rseed,size);
+         int kind = lrand(rseed,6);
+         if (kind == 0)                                                          //  flip a bit
+            buff[pos] ^= 1 << lrand(rseed,8);
+         else if (kind == 1)                                                     //  random byte
+            buff[pos] = binary ? lrand(rseed,256) : "0123456789, -\n\x7f"[lrand(rseed,15)];
+         else if (kind == 2)                                                     //  truncate
+            buff.resize(pos);
+         else if (kind == 3)                                                     //  add garbage
+            for (kk = lrand(rseed,64); kk > 0; kk--) buff.push_back(lrand(rseed,256));
+         else if (kind == 4 && size > 8) {                                       //  copy 4 bytes elsewhere
+            int pos1 = lrand(rseed,size-3) & (binary ? ~3 : ~0);                 //    (e.g. duplicate tile position)
+            int pos2 = lrand(rseed,size-3) & (binary ? ~3 : ~0);
+            memmove(&buff[pos2],&buff[pos1],4);
+         }
+         else if (kind == 5 && binary && size >= 64) {                           //  extreme header field
+            uint32 vv[4] = { 0, 1, 0x7fffffff, 0xffffffff };
+            memcpy(&buff[8 + 4 * lrand(rseed,14)],&vv[lrand(rseed,4)],4);
+         }
+      }
+
+      if (binary && buff.size() > 8 && lrand(rseed,2)) {                         //  checksum OK after damage
+         uint64 csum = le64(zhash64(&buff[0],buff.size()-8));
+         memcpy(&buff[buff.size()-8],&csum,8);
+      }
+
+      if (zwrite_atomic(file.c_str(),buff.data(),buff.size())) {
+         printf("cannot write: %s \n",file.c_str());
+         return 1;
+      }
+
+      pstate.init(1);
+      Ntiles = Nrows = Ncols = 0;
+      stat = puzzle_read(file.c_str(),image,ihash,Nfix);
+      if (stat) {
+         Nbad++;
+         continue;
+      }
+
+      if (Nfix) Nfixed++;
+      else Nok++;
+
+      int err = (Nrows < 1 || Ncols < 1 || Ntiles != Nrows * Ncols);             //  must be a permutation
+      used.assign((Ntiles + 63) / 64,0);
+      for (kk = 0; kk < Ntiles && ! err; kk++) {
+         uint32 pp = pstate.wposn(kk);
+         if (pp >= (uint32) Ntiles || (used[pp >> 6] >> (pp & 63) & 1)) err = 1;
+         else used[pp >> 6] |= 1ULL << (pp & 63);
+      }
+      if (err) {
+         printf("  iteration %d: not a permutation \n",iter);
+         Nerr++;
+      }
+   }
+
+   remove(file.c_str());
+   printf("%d damaged files: %d rejected, %d repaired, %d read unchanged, %d errors \n",
+                                          Niter,Nbad,Nfixed,Nok,Nerr);
+   return Nerr > 0;
+}
+
+
+
+//  older text format, 10k, 100k and 1M tile boards, randomly mixed:
+//  former fscanf() reader vs puzzle_read(), same tile positions,
+//  and the error message for a damaged file
+
+int bench_text()
+{
+   int         dims[3][2] = { { 100, 100 }, { 400, 250 }, { 1000, 1000 } };
+   string      image, file = "/tmp/picpuz-bench.txt";
+   uint64      ihash;
+   double      time0, secs[2];
+   int         err[2], Nfix, bad = 0;
+   struct stat sb;
+
+   rseed = 1;
+
+   printf("      tiles       bytes    fscanf    parser (secs)  speedup \n");
+
+   for (int dd = 0; dd < 3; dd++)
+   {
+      bench_board(dims[dd][0],dims[dd][1]);
+      for (int ii = Ntiles - 1; ii > 0; ii--) pstate.swap(ii,lrand(rseed,ii+1)); //  random permutation
+      misplaced_init();
+      groups_init();
+      vector<uint32> posn0(Ntiles);
+      for (int ii = 0; ii < Ntiles; ii++) posn0[ii] = pstate.wposn(ii);
+
+      if (bench_write_text(file.c_str())) return 1;
+      stat(file.c_str(),&sb);
+
+      for (int kk = 0; kk < 2; kk++)                                             //  old, new reader
+      {
+         pstate.init(1);
+         Ntiles = Nrows = Ncols = 0;
+         start_timer(time0);
+         if (kk == 0) err[0] = bench_read_fscanf(file.c_str(),image);
+         else err[1] = puzzle_read(file.c_str(),image,ihash,Nfix);
+         secs[kk] = get_timer(time0);
+         if (err[kk] || Ntiles != dims[dd][0] * dims[dd][1] || image != imagefile) bad++;
+         else for (int ii = 0; ii < Ntiles; ii++)
+            if (pstate.wposn(ii) != (int) posn0[ii]) bad++;
+      }
+
+      printf("   %8d  %10lld  %8.4f  %8.4f  %12.1f \n",dims[dd][0] * dims[dd][1],
+                           (int64) sb.st_size,secs[0],secs[1],secs[0] / secs[1]);
+   }
+
+   FILE *fid = fopen(file.c_str(),"w");                                          //  damaged file
+   if (! fid) return 1;
+   fprintf(fid,"%s \n 4 0 \n 2 2 \n 0,0  1,1 \n 1;0  0,1 \n",imagefile.c_str());
+   fclose(fid);
+   err[1] = puzzle_read(file.c_str(),image,ihash,Nfix);
+   printf("   damaged file: %s \n",puz_error.c_str());
+   if (err[1] != 2) bad++;
+
+   printf("   mismatches %d \n",bad);
+   remove(file.c_str());
+   return bad > 0;
+}
+
+
 //  supply unused zdialog callback function
 
 void KBstate(GdkEventKey *event, int state)
@@ -27,6 +27,9 @@
 //     zfuncs.cpp   version  v.6.2
 
 #include "zfuncs.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>                                                           //  SSE2, AVX2 intrinsics
+#endif
 
 static void *zmalloc(unsigned int cc);                                                          //  malloc() with counter              v.5.8
 static void zfree(void *pp);                                                            //  free() with counter
@@ -136,6 +139,7 @@ static PIXBUF * get_thumbnail(cchar *fpath, int size);
    global_lock             lock/unlock a global resource (all processes/threads)
    zget_locked, etc.       safely access parameters from multiple threads
    start_detached_thread   simplified method to start a detached thread
+   do_wthreads             run a function in N parallel threads and wait for all
    synch_threads           make threads pause and resume together
    shell_quiet             format and run a shell command, return status
    shell_ack                  ""  + popup error message if error
@@ -144,6 +148,7 @@ static PIXBUF * get_thumbnail(cchar *fpath, int size);
    signalProc              pause, resume, or kill a child process
    runroot                 run a command or program as root user
    fgets_trim              fgets() with trim of trailing \r \n and optionally blanks
+   zwrite_atomic           replace a file with new data, all or nothing (crash safe)
    samedirk                test if two files/directories have the same directory path
    parsefile               parse filespec into directory, file, extension
    check_create_dir        check if directory exists, ask to create if not
@@ -284,6 +289,10 @@ static PIXBUF * get_thumbnail(cchar *fpath, int size);
    zmakecursor             make a cursor from an image file (.png .jpg)
    gdk_pixbuf_rotate       rotate a pixbuf through any angle
    gdk_pixbuf_stripalpha   remove an alpha channel from a pixbuf
+   zpixbuf_scale           rescale a pixbuf using all CPU cores and SIMD
+   zpixbuf_surface         convert a pixbuf to a cairo image surface, SIMD
+   zsad8                   sum of absolute differences of two byte arrays, SIMD
+   zhash64                 fast 64-bit hash of a byte array, e.g. file checksum
    text_pixbuf             create pixbuf containing text 
 
 
@@ -576,6 +585,88 @@ void zsleep(double dsecs)
 }
 
 
+/**************************************************************************/
+
+//  get the number of CPU cores available for worker threads
+
+int get_Ncores()
+{
+   static int  Ncores = 0;
+
+   if (! Ncores) {
+      Ncores = sysconf(_SC_NPROCESSORS_ONLN);
+      if (Ncores < 1) Ncores = 1;
+      if (Ncores > wthreads_max) Ncores = wthreads_max;
+   }
+   return Ncores;
+}
+
+
+//  start a detached thread with the given function and argument
+//  the thread exits when the function returns
+
+pthread_t start_detached_thread(void * threadfunc(void *), void *arg)
+{
+   pthread_attr_t    attr;
+   pthread_t         tid;
+   int               err;
+
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED);
+   err = pthread_create(&tid,&attr,threadfunc,arg);
+   pthread_attr_destroy(&attr);
+   if (err) zappcrash("pthread_create() failure: %s",wstrerror(err));
+   return tid;
+}
+
+
+//  Run a work function in Nt parallel threads and wait until all are done.
+//  Each thread calls func(arg,index) with index = 0 ... Nt-1, so the work can
+//  be split in bands by index. The calling thread runs index 0 itself.
+
+namespace wthreads_names {
+   struct wthread_t {
+      void     (*func)(void *arg, int index);
+      void     *arg;
+      int      index;
+   };
+
+   void * wthread(void *vp)                                                      //  thread function
+   {
+      wthread_t *wt = (wthread_t *) vp;
+      wt->func(wt->arg,wt->index);
+      return 0;
+   }
+}
+
+void do_wthreads(void func(void *arg, int index), void *arg, int Nt)
+{
+   using namespace wthreads_names;
+
+   wthread_t   wt[wthreads_max];
+   pthread_t   tid[wthreads_max];
+   int         ii, err;
+
+   if (Nt < 1) Nt = 1;
+   if (Nt > wthreads_max) Nt = wthreads_max;
+
+   for (ii = 1; ii < Nt; ii++) {                                                 //  start threads 1 ... Nt-1
+      wt[ii].func = func;
+      wt[ii].arg = arg;
+      wt[ii].index = ii;
+      err = pthread_create(&tid[ii],0,wthread,&wt[ii]);
+      if (err) zappcrash("pthread_create() failure: %s",wstrerror(err));
+   }
+
+   func(arg,0);                                                                  //  do index 0 in this thread
+
+   for (ii = 1; ii < Nt; ii++)                                                   //  wait for the rest
+      pthread_join(tid[ii],0);
+
+   return;
+}
+
+
 
 
 /**************************************************************************/
@@ -783,6 +874,58 @@ char * fgets_trim(char *buff, int maxcc, FILE *fid, int bf)
 }
 
 
+/**************************************************************************/
+
+//  Replace a file with new data[cc], all or nothing. The data is written
+//  to file.tmp, flushed to disk and renamed to file, and the directory
+//  is flushed, so after a crash or power loss the file has either the
+//  old or the new content, never a part. Returns 0 if OK, else errno.
+
+int zwrite_atomic(cchar *file, const void *data, size_t cc)
+{
+   char        tfile[XFCC+8], dirk[XFCC], *pp;
+   const char  *data2 = (const char *) data;
+   int         fd, err = 0;
+   ssize_t     cc2;
+
+   if (strlen(file) > XFCC) return ENAMETOOLONG;
+   snprintf(tfile,XFCC+8,"%s.tmp",file);
+
+   fd = open(tfile,O_WRONLY|O_CREAT|O_TRUNC,0644);
+   if (fd < 0) return errno;
+
+   while (cc && ! err) {                                                         //  write all, retry partial write
+      cc2 = write(fd,data2,cc);
+      if (cc2 < 0 && errno == EINTR) continue;
+      if (cc2 <= 0) err = cc2 ? errno : EIO;
+      else {
+         data2 += cc2;
+         cc -= cc2;
+      }
+   }
+
+   if (! err && fsync(fd)) err = errno;                                          //  data on disk before rename
+   if (close(fd) && ! err) err = errno;
+   if (! err && rename(tfile,file)) err = errno;
+   if (err) {
+      remove(tfile);
+      return err;
+   }
+
+   strncpy0(dirk,file,XFCC);                                                     //  rename on disk
+   pp = strrchr(dirk,'/');
+   if (pp) *(pp == dirk ? pp+1 : pp) = 0;
+   else strcpy(dirk,".");
+   fd = open(dirk,O_RDONLY|O_DIRECTORY);
+   if (fd >= 0) {
+      fsync(fd);
+      close(fd);
+   }
+
+   return 0;
+}
+
+
 
 
 /**************************************************************************
@@ -7189,7 +7332,7 @@ int popup_image_paint(GtkWidget *drawarea, cairo_t *cr, cchar *file)
    if (ww2 < sww && hh2 < shh)                                                   //  prevent GTK resize event loop
       gtk_window_resize(GTK_WINDOW(window),ww2,hh2);
 
-   pixb2 = gdk_pixbuf_scale_simple(pixb1,ww2,hh2,GDK_INTERP_BILINEAR);           //  rescale pixbuf to window
+   pixb2 = zpixbuf_scale(pixb1,ww2,hh2);                                         //  rescale pixbuf to window
    if (! pixb2) return 1;
 
    gdk_cairo_set_source_pixbuf(cr,pixb2,0,0);                                    //  paint image
@@ -8041,3 +8184,613 @@ PIXBUF * get_thumbnail(cchar *fpath, int size)
                0.31 secs.  3.3 GHz Core i5
 
 ***/
+
+
+/**************************************************************************
+
+   PIXBUF * zpixbuf_scale(PIXBUF *pixbuf, int ww, int hh, int filter)
+
+   Rescale a pixbuf to size ww x hh and return a new pixbuf.
+   The caller must g_object_unref() the returned pixbuf.
+
+   filter:  ZSCALE_BOX       area average when reducing, bilinear when enlarging
+            ZSCALE_LANCZOS   Lanczos-3 windowed sinc, sharper but slower
+
+   Pixbuf must have 8 bits per channel and 3 or 4 channels, else the
+   work is passed to gdk_pixbuf_scale_simple().
+
+   Algorithm:
+      separable filter: horizontal pass, then vertical pass
+      filter taps and weights are computed once per output column and row
+      output rows are split in bands, one band per CPU core (do_wthreads)
+      each band keeps a ring of horizontally scaled source rows (float),
+         so each source row is filtered horizontally only once per band
+      vertical pass sums ring rows * weights and stores bytes, using
+         AVX2 or SSE2 when the CPU has it, else plain C
+
+   Benchmark: picpuz -bench scale <imagefile>
+
+***/
+
+namespace zpixbuf_scale_names
+{
+   struct taps_t {                                                               //  filter taps for one axis
+      int               maxtaps;                                                 //  max. taps per output pixel
+      std::vector<int>  start, count;                                            //  1st source pixel, tap count
+      std::vector<float>  weight;                                                //  [output pixel][maxtaps]
+   };
+
+   struct job_t {                                                                //  one rescale job
+      uint8       *pix1, *pix2;                                                  //  input, output pixels
+      int         ww1, hh1, rs1;                                                 //  input size, rowstride
+      int         ww2, hh2, rs2;                                                 //  output size, rowstride
+      int         nch;                                                           //  channels, 3 or 4
+      int         Nt;                                                            //  thread count
+      int         simd;                                                          //  cpu_simd()
+      taps_t      htaps, vtaps;
+   };
+
+   double lanczos3(double x)
+   {
+      if (x < 0) x = -x;
+      if (x < 1e-6) return 1.0;
+      if (x >= 3.0) return 0.0;
+      double px = M_PI * x;
+      return 3.0 * sin(px) * sin(px / 3.0) / (px * px);
+   }
+
+   //  compute filter taps mapping nin input pixels to nout output pixels
+
+   void get_taps(taps_t &taps, int nin, int nout, int filter)
+   {
+      double   scale = 1.0 * nout / nin;                                         //  < 1 = reduce
+      double   inv = 1.0 * nin / nout;
+      double   support, center, x1, x2, sum, w;
+      int      ii, jj, j1, j2, nn;
+      std::vector<double>  wtemp;
+
+      if (filter == ZSCALE_LANCZOS)
+         support = (scale < 1) ? 3.0 * inv : 3.0;
+      else
+         support = (scale < 1) ? 0.5 * inv : 1.0;
+
+      taps.maxtaps = int(2 * support) + 3;
+      taps.start.resize(nout);
+      taps.count.resize(nout);
+      taps.weight.assign(nout * taps.maxtaps,0);
+      wtemp.resize(taps.maxtaps);
+
+      for (ii = 0; ii < nout; ii++)
+      {
+         center = (ii + 0.5) * inv;                                              //  output pixel center in input
+         j1 = int(floor(center - support));
+         j2 = int(ceil(center + support));
+         if (j1 < 0) j1 = 0;
+         if (j2 > nin - 1) j2 = nin - 1;
+         if (j2 - j1 + 1 > taps.maxtaps) j2 = j1 + taps.maxtaps - 1;
+
+         sum = 0;
+         for (jj = j1; jj <= j2; jj++)
+         {
+            if (filter == ZSCALE_LANCZOS) {
+               if (scale < 1) w = lanczos3((jj + 0.5 - center) * scale);
+               else w = lanczos3(jj + 0.5 - center);
+            }
+            else if (scale < 1) {                                                //  box: overlap of input pixel
+               x1 = ii * inv;                                                    //    with output pixel footprint
+               x2 = x1 + inv;
+               if (jj > x1) x1 = jj;
+               if (jj + 1 < x2) x2 = jj + 1;
+               w = x2 - x1;
+               if (w < 0) w = 0;
+            }
+            else {                                                               //  bilinear when enlarging
+               w = 1.0 - fabs(jj + 0.5 - center);
+               if (w < 0) w = 0;
+            }
+            wtemp[jj-j1] = w;
+            sum += w;
+         }
+
+         while (j2 > j1 && wtemp[j2-j1] == 0) j2--;                              //  drop zero taps at ends
+         while (j1 < j2 && wtemp[0] == 0) {
+            for (jj = j1; jj < j2; jj++) wtemp[jj-j1] = wtemp[jj-j1+1];
+            j1++;
+         }
+
+         nn = j2 - j1 + 1;
+         if (sum == 0) sum = 1;
+         taps.start[ii] = j1;
+         taps.count[ii] = nn;
+         for (jj = 0; jj < nn; jj++)
+            taps.weight[ii * taps.maxtaps + jj] = wtemp[jj] / sum;               //  normalize, sum = 1
+      }
+
+      return;
+   }
+
+   //  horizontal pass: one input row to one float row of output width
+
+   void hpass(job_t *job, int row, float *out)
+   {
+      uint8    *pix = job->pix1 + row * job->rs1;
+      int      nch = job->nch, ii, jj, nn;
+      float    *wt, w, r, g, b, a;
+      uint8    *pp;
+
+      for (ii = 0; ii < job->ww2; ii++)
+      {
+         nn = job->htaps.count[ii];
+         wt = &job->htaps.weight[ii * job->htaps.maxtaps];
+         pp = pix + job->htaps.start[ii] * nch;
+         r = g = b = a = 0;
+
+         if (nch == 3) {
+            for (jj = 0; jj < nn; jj++, pp += 3) {
+               w = wt[jj];
+               r += w * pp[0];
+               g += w * pp[1];
+               b += w * pp[2];
+            }
+            out[0] = r;
+            out[1] = g;
+            out[2] = b;
+            out += 3;
+         }
+         else {
+            for (jj = 0; jj < nn; jj++, pp += 4) {
+               w = wt[jj];
+               r += w * pp[0];
+               g += w * pp[1];
+               b += w * pp[2];
+               a += w * pp[3];
+            }
+            out[0] = r;
+            out[1] = g;
+            out[2] = b;
+            out[3] = a;
+            out += 4;
+         }
+      }
+
+      return;
+   }
+
+   //  vertical pass: out[i] = sum over taps: weight[k] * rows[k][i]
+   //  for i = i0 ... nn-1, result rounded and clamped to 0-255
+
+   void vpass_C(uint8 *out, float **rows, float *wt, int ntaps, int i0, int nn)
+   {
+      float    sum;
+      int      ii, kk, val;
+
+      for (ii = i0; ii < nn; ii++) {
+         sum = 0;
+         for (kk = 0; kk < ntaps; kk++)
+            sum += wt[kk] * rows[kk][ii];
+         val = int(sum + 0.5f);
+         if (val < 0) val = 0;
+         if (val > 255) val = 255;
+         out[ii] = val;
+      }
+      return;
+   }
+
+#if defined(__x86_64__) || defined(__i386__)
+
+   __attribute__((target("sse2")))
+   void vpass_SSE2(uint8 *out, float **rows, float *wt, int ntaps, int i0, int nn)
+   {
+      int      ii, kk;
+      __m128   w, s0, s1, s2, s3;
+      __m128i  v0, v1, v2, v3;
+
+      for (ii = i0; ii + 16 <= nn; ii += 16)                                      //  16 channel values per loop
+      {
+         s0 = s1 = s2 = s3 = _mm_setzero_ps();
+         for (kk = 0; kk < ntaps; kk++) {
+            w = _mm_set1_ps(wt[kk]);
+            float *rp = rows[kk] + ii;
+            s0 = _mm_add_ps(s0,_mm_mul_ps(w,_mm_loadu_ps(rp)));
+            s1 = _mm_add_ps(s1,_mm_mul_ps(w,_mm_loadu_ps(rp+4)));
+            s2 = _mm_add_ps(s2,_mm_mul_ps(w,_mm_loadu_ps(rp+8)));
+            s3 = _mm_add_ps(s3,_mm_mul_ps(w,_mm_loadu_ps(rp+12)));
+         }
+         v0 = _mm_cvtps_epi32(s0);                                               //  round to int
+         v1 = _mm_cvtps_epi32(s1);
+         v2 = _mm_cvtps_epi32(s2);
+         v3 = _mm_cvtps_epi32(s3);
+         v0 = _mm_packs_epi32(v0,v1);                                            //  pack to 16 bits
+         v2 = _mm_packs_epi32(v2,v3);
+         _mm_storeu_si128((__m128i *) (out + ii),_mm_packus_epi16(v0,v2));       //  pack to 8 bits, clamp 0-255
+      }
+
+      vpass_C(out,rows,wt,ntaps,ii,nn);                                          //  remainder
+      return;
+   }
+
+   __attribute__((target("avx2")))
+   void vpass_AVX2(uint8 *out, float **rows, float *wt, int ntaps, int i0, int nn)
+   {
+      int      ii, kk;
+      __m256   w, s0, s1, s2, s3;
+      __m256i  v0, v1, v2, v3;
+      __m256i  perm = _mm256_setr_epi32(0,4,1,5,2,6,3,7);                        //  undo lane interleave of packs
+
+      for (ii = i0; ii + 32 <= nn; ii += 32)                                      //  32 channel values per loop
+      {
+         s0 = s1 = s2 = s3 = _mm256_setzero_ps();
+         for (kk = 0; kk < ntaps; kk++) {
+            w = _mm256_set1_ps(wt[kk]);
+            float *rp = rows[kk] + ii;
+            s0 = _mm256_add_ps(s0,_mm256_mul_ps(w,_mm256_loadu_ps(rp)));
+            s1 = _mm256_add_ps(s1,_mm256_mul_ps(w,_mm256_loadu_ps(rp+8)));
+            s2 = _mm256_add_ps(s2,_mm256_mul_ps(w,_mm256_loadu_ps(rp+16)));
+            s3 = _mm256_add_ps(s3,_mm256_mul_ps(w,_mm256_loadu_ps(rp+24)));
+         }
+         v0 = _mm256_cvtps_epi32(s0);
+         v1 = _mm256_cvtps_epi32(s1);
+         v2 = _mm256_cvtps_epi32(s2);
+         v3 = _mm256_cvtps_epi32(s3);
+         v0 = _mm256_packs_epi32(v0,v1);
+         v2 = _mm256_packs_epi32(v2,v3);
+         v0 = _mm256_packus_epi16(v0,v2);
+         v0 = _mm256_permutevar8x32_epi32(v0,perm);
+         _mm256_storeu_si256((__m256i *) (out + ii),v0);
+      }
+
+      vpass_SSE2(out,rows,wt,ntaps,ii,nn);                                       //  remainder
+      return;
+   }
+
+   int cpu_simd_detect()
+   {
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2")) return 2;
+      if (__builtin_cpu_supports("sse2")) return 1;
+      return 0;
+   }
+
+   int cpu_simd()                                                                //  2 = AVX2, 1 = SSE2
+   {
+      static const int  simd = cpu_simd_detect();                                //  initialized once, thread safe
+      return simd;
+   }
+
+#else
+
+   int cpu_simd() { return 0; }
+
+#endif
+
+   //  thread function: rescale one band of output rows
+
+   void scale_band(void *arg, int index)
+   {
+      job_t    *job = (job_t *) arg;
+      int      row1 = job->hh2 * index / job->Nt;                                //  output rows for this band
+      int      row2 = job->hh2 * (index + 1) / job->Nt;
+      int      nring = job->vtaps.maxtaps;
+      int      nn = job->ww2 * job->nch;                                         //  channel values per row
+      int      simd = job->simd;
+      int      row, kk, srow, slot, ntaps;
+      float    *wt;
+
+      std::vector<float *> rows(nring);                                          //  ring rows for one output row
+      std::vector<float>  ring(nring * nn);                                      //  horizontally scaled rows
+      std::vector<int>    ringrow(nring,-1);                                     //  source row in each slot
+
+      for (row = row1; row < row2; row++)
+      {
+         ntaps = job->vtaps.count[row];
+         wt = &job->vtaps.weight[row * nring];
+
+         for (kk = 0; kk < ntaps; kk++)
+         {
+            srow = job->vtaps.start[row] + kk;
+            slot = srow % nring;
+            if (ringrow[slot] != srow) {                                         //  not done yet
+               hpass(job,srow,&ring[slot * nn]);
+               ringrow[slot] = srow;
+            }
+            rows[kk] = &ring[slot * nn];
+         }
+
+         uint8 *out = job->pix2 + row * job->rs2;
+#if defined(__x86_64__) || defined(__i386__)
+         if (simd == 2) vpass_AVX2(out,&rows[0],wt,ntaps,0,nn);
+         else if (simd == 1) vpass_SSE2(out,&rows[0],wt,ntaps,0,nn);
+         else vpass_C(out,&rows[0],wt,ntaps,0,nn);
+#else
+         vpass_C(out,&rows[0],wt,ntaps,0,nn);
+#endif
+      }
+
+      return;
+   }
+}
+
+
+PIXBUF * zpixbuf_scale(PIXBUF *pixbuf1, int ww2, int hh2, int filter)
+{
+   using namespace zpixbuf_scale_names;
+
+   PIXBUF      *pixbuf2;
+   job_t       job;
+   int         nch, Nt;
+
+   nch = gdk_pixbuf_get_n_channels(pixbuf1);
+   if (gdk_pixbuf_get_bits_per_sample(pixbuf1) != 8 || nch < 3 || nch > 4)       //  unsupported format
+      return gdk_pixbuf_scale_simple(pixbuf1,ww2,hh2,GDK_INTERP_BILINEAR);
+
+   if (ww2 < 1) ww2 = 1;
+   if (hh2 < 1) hh2 = 1;
+
+   pixbuf2 = gdk_pixbuf_new(GDK_COLORSPACE_RGB,nch == 4,8,ww2,hh2);
+   if (! pixbuf2) return 0;
+
+   job.pix1 = gdk_pixbuf_get_pixels(pixbuf1);
+   job.ww1 = gdk_pixbuf_get_width(pixbuf1);
+   job.hh1 = gdk_pixbuf_get_height(pixbuf1);
+   job.rs1 = gdk_pixbuf_get_rowstride(pixbuf1);
+   job.pix2 = gdk_pixbuf_get_pixels(pixbuf2);
+   job.ww2 = ww2;
+   job.hh2 = hh2;
+   job.rs2 = gdk_pixbuf_get_rowstride(pixbuf2);
+   job.nch = nch;
+   job.simd = cpu_simd();                                                        //  once, not in each thread
+
+   get_taps(job.htaps,job.ww1,ww2,filter);
+   get_taps(job.vtaps,job.hh1,hh2,filter);
+
+   Nt = get_Ncores();                                                            //  at least 32 output rows per band
+   if (Nt > hh2 / 32) Nt = hh2 / 32;
+   if (Nt < 1) Nt = 1;
+   job.Nt = Nt;
+
+   do_wthreads(scale_band,&job,Nt);
+   return pixbuf2;
+}
+
+
+/**************************************************************************
+
+   cairo_surface_t * zpixbuf_surface(PIXBUF *pixbuf)
+
+   Convert a pixbuf to a new cairo image surface, for use as a cairo
+   source without the conversion done by gdk_cairo_set_source_pixbuf()
+   at every paint. The caller must cairo_surface_destroy() the surface.
+
+   3 channels (RGB): CAIRO_FORMAT_RGB24, BGRX in memory (x86)
+   4 channels (RGBA): CAIRO_FORMAT_ARGB32, RGB premultiplied by alpha
+
+   NULL is returned if the pixbuf is NULL or not 8 bits, 3 or 4 channels.
+
+   RGB rows are converted 4 pixels at a time with an SSSE3 byte shuffle
+   when the CPU has it. Rows are split in bands, one per CPU core.
+
+***/
+
+namespace zpixbuf_surface_names
+{
+   struct job_t {
+      uint8       *pix1, *pix2;                                                  //  pixbuf, surface pixels
+      int         ww, hh, rs1, rs2, nch, Nt;
+      int         ssse3;                                                         //  cpu_ssse3()
+   };
+
+   void conv_C(uint8 *pix1, uint32 *pix2, int nch, int ii, int ww)               //  pixels ii to ww-1
+   {
+      uint32   red, green, blue, alpha;
+
+      for ( ; ii < ww; ii++)
+      {
+         red = pix1[ii*nch];
+         green = pix1[ii*nch+1];
+         blue = pix1[ii*nch+2];
+         if (nch == 4) {                                                         //  premultiply, round
+            alpha = pix1[ii*4+3];
+            red = (red * alpha + 128) * 257 >> 16;
+            green = (green * alpha + 128) * 257 >> 16;
+            blue = (blue * alpha + 128) * 257 >> 16;
+         }
+         else alpha = 255;
+         pix2[ii] = alpha << 24 | red << 16 | green << 8 | blue;
+      }
+      return;
+   }
+
+#if defined(__x86_64__) || defined(__i386__)
+
+   __attribute__((target("ssse3")))
+   void conv_SSSE3(uint8 *pix1, uint32 *pix2, int ww)                            //  RGB only
+   {
+      const __m128i  shuf = _mm_setr_epi8(2,1,0,-1, 5,4,3,-1, 8,7,6,-1, 11,10,9,-1);
+      const __m128i  alpha = _mm_set1_epi32(0xff000000);
+      int            ii;
+
+      for (ii = 0; ii + 6 <= ww; ii += 4)                                        //  16 byte load reads 5.3 pixels
+      {
+         __m128i v0 = _mm_loadu_si128((__m128i *) (pix1 + ii * 3));
+         v0 = _mm_or_si128(_mm_shuffle_epi8(v0,shuf),alpha);
+         _mm_storeu_si128((__m128i *) (pix2 + ii),v0);
+      }
+
+      conv_C(pix1,pix2,3,ii,ww);                                                 //  remainder
+      return;
+   }
+
+   int cpu_ssse3_detect()
+   {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("ssse3") ? 1 : 0;
+   }
+
+   int cpu_ssse3()
+   {
+      static const int  ssse3 = cpu_ssse3_detect();                              //  initialized once, thread safe
+      return ssse3;
+   }
+
+#else
+
+   int cpu_ssse3() { return 0; }
+
+#endif
+
+   //  thread function: convert one band of rows
+
+   void conv_band(void *arg, int index)
+   {
+      job_t    *job = (job_t *) arg;
+      int      row1 = job->hh * index / job->Nt;
+      int      row2 = job->hh * (index + 1) / job->Nt;
+      int      ssse3 = job->ssse3;
+
+      for (int row = row1; row < row2; row++)
+      {
+         uint8 *pix1 = job->pix1 + row * job->rs1;
+         uint32 *pix2 = (uint32 *) (job->pix2 + row * job->rs2);
+#if defined(__x86_64__) || defined(__i386__)
+         if (ssse3 && job->nch == 3) conv_SSSE3(pix1,pix2,job->ww);
+         else conv_C(pix1,pix2,job->nch,0,job->ww);
+#else
+         conv_C(pix1,pix2,job->nch,0,job->ww);
+#endif
+      }
+
+      return;
+   }
+}
+
+
+cairo_surface_t * zpixbuf_surface(PIXBUF *pixbuf)
+{
+   using namespace zpixbuf_surface_names;
+
+   cairo_surface_t   *surface;
+   job_t             job;
+   int               Nt;
+
+   if (! pixbuf) return 0;
+   job.nch = gdk_pixbuf_get_n_channels(pixbuf);
+   if (gdk_pixbuf_get_bits_per_sample(pixbuf) != 8 || job.nch < 3 || job.nch > 4)
+      return 0;
+
+   job.ww = gdk_pixbuf_get_width(pixbuf);
+   job.hh = gdk_pixbuf_get_height(pixbuf);
+   surface = cairo_image_surface_create(job.nch == 4 ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,job.ww,job.hh);
+   if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+      cairo_surface_destroy(surface);
+      return 0;
+   }
+
+   cairo_surface_flush(surface);                                                 //  before direct pixel access
+   job.pix1 = gdk_pixbuf_get_pixels(pixbuf);
+   job.rs1 = gdk_pixbuf_get_rowstride(pixbuf);
+   job.pix2 = cairo_image_surface_get_data(surface);
+   job.rs2 = cairo_image_surface_get_stride(surface);
+   job.ssse3 = cpu_ssse3();                                                      //  once, not in each thread
+
+   Nt = get_Ncores();                                                            //  at least 64 rows per band
+   if (Nt > job.hh / 64) Nt = job.hh / 64;
+   if (Nt < 1) Nt = 1;
+   job.Nt = Nt;
+
+   do_wthreads(conv_band,&job,Nt);
+   cairo_surface_mark_dirty(surface);
+   return surface;
+}
+
+
+/**************************************************************************
+
+   uint32 zsad8(const uint8 *pp1, const uint8 *pp2, int nn)
+
+   Sum of absolute differences of two byte arrays pp1[nn] and pp2[nn],
+   e.g. to compare two rows of pixels. 16 bytes at a time with SSE2.
+
+***/
+
+uint32 zsad8(const uint8 *pp1, const uint8 *pp2, int nn)
+{
+   uint32   sum = 0;
+   int      ii = 0;
+
+#if defined(__x86_64__)                                                          //  SSE2 always present
+   __m128i  acc = _mm_setzero_si128();
+
+   for ( ; ii + 16 <= nn; ii += 16)
+   {
+      __m128i v1 = _mm_loadu_si128((const __m128i *) (pp1 + ii));
+      __m128i v2 = _mm_loadu_si128((const __m128i *) (pp2 + ii));
+      acc = _mm_add_epi64(acc,_mm_sad_epu8(v1,v2));                              //  2 sums of 8 bytes each
+   }
+
+   sum = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc,8));
+#endif
+
+   for ( ; ii < nn; ii++)                                                        //  remainder
+      sum += abs(pp1[ii] - pp2[ii]);
+
+   return sum;
+}
+
+
+/**************************************************************************
+
+   uint64 zhash64(const void *data, size_t nn, uint64 seed = 0)
+
+   64-bit hash of a byte array data[nn], for checksums and content
+   identity (not cryptographic). 16 bytes per step in two independent
+   lanes, multiply-rotate rounds and final avalanche as in xxHash64.
+   Bytes are read as little-endian words: same result on any CPU.
+
+***/
+
+namespace zhash64_names
+{
+   const uint64   P1 = 0x9E3779B185EBCA87ULL, P2 = 0xC2B2AE3D27D4EB4FULL;
+
+   inline uint64 rotl(uint64 hh, int nn) { return (hh << nn) | (hh >> (64 - nn)); }
+   inline uint64 mixw(uint64 hh, uint64 ww) { return rotl(hh + ww * P2,31) * P1; }
+
+   inline uint64 load64(const uint8 *pp) {
+      uint64 ww;
+      memcpy(&ww,pp,8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      ww = __builtin_bswap64(ww);
+#endif
+      return ww;
+   }
+}
+
+uint64 zhash64(const void *data, size_t nn, uint64 seed)
+{
+   using namespace zhash64_names;
+
+   const uint8 *pp = (const uint8 *) data;
+   uint8       tail[16];
+   uint64      h1 = seed + P1, h2 = seed - P2, hh;
+   size_t      ii;
+
+   for (ii = 0; ii + 16 <= nn; ii += 16) {                                       //  2 lanes, 8 bytes each
+      h1 = mixw(h1,load64(pp+ii));
+      h2 = mixw(h2,load64(pp+ii+8));
+   }
+
+   if (ii < nn) {                                                                //  last 1-15 bytes, zero padded
+      memset(tail,0,16);
+      memcpy(tail,pp+ii,nn-ii);
+      h1 = mixw(h1,load64(tail));
+      h2 = mixw(h2,load64(tail+8));
+   }
+
+   hh = rotl(h1,1) + rotl(h2,7) + nn;                                            //  merge lanes and length
+   hh ^= hh >> 33;                                                               //  avalanche
+   hh *= P2;
+   hh ^= hh >> 29;
+   hh *= P1;
+   hh ^= hh >> 32;
+   return hh;
+}
@@ -85,10 +85,18 @@
 
                                              //  get disk temp, e.g. "/dev/sda"     v.5.9
 void zsleep(double dsecs);                                                       //  sleep specified seconds
+void start_timer(double &time0);                                                 //  start a timer
+double get_timer(double &time0);                                                 //  get elapsed time in seconds
+
+#define  wthreads_max 32                                                         //  max. parallel work threads
+int  get_Ncores();                                                               //  CPU cores for work threads
+pthread_t start_detached_thread(void * tfunc(void *), void * arg);               //  start detached thread function
+void do_wthreads(void func(void *arg, int index), void *arg, int Nt);            //  run func in Nt threads, wait for all
 
 
 int shell_ack(cchar *command, ...);                                              //   ""  + popup an error message if error
 char * fgets_trim(char * buff, int maxcc, FILE *, int bf = 0);                   //  fgets + trim trailing \n \r (blanks)
+int zwrite_atomic(cchar *file, const void *data, size_t cc);                      //  replace file content, all or nothing
 
 
 //  string macros and functions ===========================================
@@ -336,6 +344,24 @@ std::string zgetfile(cchar *title, GtkWindow *parent, cchar *action, cchar *file
 
 void print_image_file(GtkWidget *parent, cchar *imagefile);
 
+//  rescale a pixbuf using all CPU cores and SIMD, caller must g_object_unref()
+
+#define  ZSCALE_BOX      0                                                       //  area average (bilinear if enlarging)
+#define  ZSCALE_LANCZOS  1                                                       //  Lanczos-3, sharper, slower
+PIXBUF * zpixbuf_scale(PIXBUF *pixbuf, int ww, int hh, int filter = ZSCALE_BOX);
+
+//  convert a pixbuf to a cairo image surface, caller must cairo_surface_destroy()
+
+cairo_surface_t * zpixbuf_surface(PIXBUF *pixbuf);
+
+//  sum of absolute differences of two byte arrays, SIMD
+
+uint32 zsad8(const uint8 *pp1, const uint8 *pp2, int nn);
+
+//  fast 64-bit hash of a byte array (checksums, not cryptographic)
+
+uint64 zhash64(const void *data, size_t nn, uint64 seed = 0);
+
 //  drag and drop functions
 
 typedef void drag_drop_func(int x, int y, const char *text);                           //  user function, get drag_drop text